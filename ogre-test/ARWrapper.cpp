@@ -32,13 +32,14 @@ void ARWrapper::init(string videoPath,string cameraParamsFile,float markerSize)t
   if (cameraParamsFile!="")
     try {
         CameraParams.readFromXMLFile(cameraParamsFile);
+        CameraParams.resize(TheInputImage.size());
         cout<<"PARAMS="<<CameraParams.CameraMatrix<<" "<<CameraParams.Distorsion<<endl;
         //(CameraParamsUnd.setParams(CameraParams.CameraMatrix,cv::Mat::zeros(1,4,CV_32F),CameraParams.CamSize);
     } catch (std::exception &ex) {
         cout<<ex.what()<<endl;
         exit(0);
     }
-    cv::undistort(TheInputImage,TheInputImageUnd,CameraParams.CameraMatrix,CameraParams.Distorsion);
+    CameraParams.undistort(TheInputImage,TheInputImageUnd);
     _markerSize=markerSize;
     //El ancho y el alto de una camara (No es accesible)
     mWidth=TheInputImage .cols;
@@ -129,7 +130,7 @@ bool ARWrapper::update()
         //Recorta la imagen de 1 camara (OPTIMIZAR)
         //deberia de poder acceder a una camara para que me de la imagen directamente
         TheVideoCapturer.retrieve ( TheInputImage );
-        cv::undistort(TheInputImage,TheInputImageUnd,CameraParams.CameraMatrix,CameraParams.Distorsion);
+        CameraParams.undistort(TheInputImage,TheInputImageUnd);
 
         MDetector.detect(TheInputImageUnd,TheMarkers,CameraParams,_markerSize);
         /*for (unsigned int i=0;i<TheMarkers.size();i++) {
@@ -73,6 +73,8 @@ The library main classes are:
    - aruco::BoardConfiguration: A board is an array of markers in a known order. BoardConfiguracion is the class that defines a board by indicating the id of its markers. In addition, it has informacion about the distance between the markers so that extrinsica camera computations can be done.
    - aruco::Board: This class defines a board detected in a image. The board has the extrinsic camera parameters as public atributes. In addition, it has a method that allows obtain the matrix for getting its position in OpenGL (see aruco_test_board_gl for details).
    - aruco::BoardDetector : This is the class in charge of detecting a board in a image. You must pass to it the set of markers detected by ArMarkerDetector and the BoardConfiguracion of the board you want to detect. This class will do the rest for you, even calculating the camera extrinsics.
+   - aruco::MultiBoardDetector : Detects several boards in the same images. The markers detected are assigned to their boards in a single pass, and the boards are processed in parallel.
+   - aruco::PosePredictor : Kalman filter of the pose of a marker or a board, that gives the pose expected in the frames in which the detection is skipped or fails. aruco::MarkerPosePredictor does it for all the markers seen.
 
 
 \section COMPILING COMPILING THE LIBRARY:
@@ -130,5 +132,7 @@ For testing the applications, the library provides videos and the corresponding
 
 #include "markerdetector.h"
 #include "boarddetector.h"
+#include "multiboarddetector.h"
+#include "posepredictor.h"
 #include "cvdrawingutils.h"
 
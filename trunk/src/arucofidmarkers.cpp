@@ -28,11 +28,170 @@ or implied, of Rafael Muñoz Salinas.
 
 */
 #include "arucofidmarkers.h"
+#include "mutex.h"
 #include <opencv2/imgproc/imgproc.hpp>
 using namespace cv;
 using namespace std;
 namespace aruco {
 
+/************************************
+ *
+ * Table of the valid codes
+ *
+ ************************************/
+/**The 25 inner bits of a marker are packed in an unsigned int (row by row, the first row in the most significant bits).
+ * The table maps each code that can be observed (the 1024 markers in their 4 rotations) into the id of the marker and the number of
+ * rotations required to set it in its correct position. It is an open addressing hash table that is built once, so that
+ * the analysis of a candidate requires a single look up.
+ *
+ * For error correction, the table also contains the codes at a distance of up to maxBits bits from the valid ones, together with
+ * the distance to their nearest valid code. The codes that are at the same distance of several markers are ambiguous (id -1)
+ */
+class MarkerCodeTable
+{
+public:
+    MarkerCodeTable(int maxBits);
+    /**Returns the id of the code passed (-1 if it is not valid or ambiguous), the clockwise rotations needed in nRotations and the
+     * number of bits that differ from the nearest valid code in nBits
+     */
+    int find(unsigned int code,int &nRotations,int &nBits)const
+    {
+        nBits=0;
+        for (unsigned int i=hash(code);;i=(i+1)&_mask) {
+            if (_entries[i].code==code) {
+                nRotations=_entries[i].nRotations;
+                nBits=_entries[i].nBits;
+                return _entries[i].id;
+            }
+            if (_entries[i].code==EMPTY) return -1;
+        }
+    }
+    /**Rotates 90deg a code in the same way than FiducidalMarkers::rotate
+     */
+    static unsigned int rotate(unsigned int code)
+    {
+        unsigned int out=0;
+        for (int y=0;y<5;y++)
+            for (int x=0;x<5;x++)
+                if ( (code>>(24-((4-x)*5+y)))&1 ) out|=1<<(24-(y*5+x));
+        return out;
+    }
+private:
+    static const unsigned int EMPTY=0xFFFFFFFF;
+    struct Entry {
+        unsigned int code;
+        short id;
+        char nRotations;
+        char nBits;
+    };
+    vector<Entry> _entries;
+    int _tableBits;
+    unsigned int _mask;
+    unsigned int hash(unsigned int code)const {
+        return (code*2654435761u)>>(32-_tableBits);
+    }
+    void insert(unsigned int code,int id,int nRotations,int nBits);
+};
+
+MarkerCodeTable::MarkerCodeTable(int maxBits)
+{
+    //number of codes: 4096 valid ones, and 25 and 300 times more for each one at distance 1 and 2. The table is kept below half full
+    _tableBits= maxBits<=0?13:(maxBits==1?18:22);
+    _mask=(1u<<_tableBits)-1;
+    Entry empty;
+    empty.code=EMPTY;
+    empty.id=-1;
+    empty.nRotations=0;
+    empty.nBits=0;
+    _entries.resize(_mask+1,empty);
+    unsigned int words[4]={0x10,0x17,0x09,0x0e};
+    //the valid codes first, so that they have precedence
+    vector<unsigned int> codes;
+    vector<int> ids,nRotations;
+    for (int id=0;id<1024;id++) {
+        unsigned int rotations[4];
+        rotations[0]=0;
+        for (int y=0;y<5;y++)
+            rotations[0]=(rotations[0]<<5)|words[(id>>2*(4-y)) & 0x0003];
+        for (int i=1;i<4;i++) rotations[i]=rotate(rotations[i-1]);
+        //a code observed with the marker rotated so that it requires i rotations to be in its correct position.
+        //The rotations of a symmetric marker that repeat a code are not added again, so that its corrected codes are not ambiguous
+        for (int i=0;i<4;i++) {
+            unsigned int code=rotations[(4-i)%4];
+            bool repeated=false;
+            for (int j=0;j<i;j++) repeated|=(rotations[(4-j)%4]==code);
+            if (repeated) continue;
+            codes.push_back(code);
+            ids.push_back(id);
+            nRotations.push_back(i);
+            insert(code,id,i,0);
+        }
+    }
+    //then, the ones with one bit changed, and finally the ones with two bits changed
+    if (maxBits>=1)
+        for (size_t c=0;c<codes.size();c++)
+            for (int b=0;b<25;b++)
+                insert(codes[c]^(1u<<b),ids[c],nRotations[c],1);
+    if (maxBits>=2)
+        for (size_t c=0;c<codes.size();c++)
+            for (int b=0;b<25;b++)
+                for (int b2=b+1;b2<25;b2++)
+                    insert(codes[c]^(1u<<b)^(1u<<b2),ids[c],nRotations[c],2);
+}
+
+void MarkerCodeTable::insert(unsigned int code,int id,int nRotations,int nBits)
+{
+    unsigned int i=hash(code);
+    while (_entries[i].code!=EMPTY && _entries[i].code!=code) i=(i+1)&_mask;
+    Entry &e=_entries[i];
+    if (e.code==code) {
+        //there is a nearer valid code
+        if (e.nBits<nBits) return;
+        //if a valid code is obtained from several rotations of the same marker, the smaller one is kept
+        if (nBits==0) {
+            if (e.nRotations<=nRotations) return;
+        }
+        //but if a code with errors is at the same distance of different markers, or of different rotations of the same
+        //marker (so that its orientation is unknown), it can not be corrected
+        else if (e.nBits==nBits) {
+            e.id=-1;
+            return;
+        }
+    }
+    e.code=code;
+    e.id=id;
+    e.nRotations=nRotations;
+    e.nBits=nBits;
+}
+
+//codes with up to one bit of error, built at startup
+static const MarkerCodeTable MarkerCodes(1);
+//codes with up to two bits of error. Built the first time it is required, since it is much bigger
+static cv::Ptr<MarkerCodeTable> MarkerCodes2;
+//protects the construction of MarkerCodes2, that may be required by several threads at once
+static Mutex MarkerCodes2Mutex;
+
+/**Returns the id of the code passed correcting up to maxCorrectedBits (at most 2)
+ */
+static int findMarkerCode(unsigned int code,int &nRotations,int maxCorrectedBits,int &nCorrectedBits)
+{
+    int id;
+    if (maxCorrectedBits<2) id=MarkerCodes.find(code,nRotations,nCorrectedBits);
+    else {
+        cv::Ptr<MarkerCodeTable> table;
+        {
+            ScopedLock lock(MarkerCodes2Mutex);
+            if (MarkerCodes2.empty()) MarkerCodes2=new MarkerCodeTable(2);
+            table=MarkerCodes2;
+        }
+        id=table->find(code,nRotations,nCorrectedBits);
+    }
+    if (id!=-1 && nCorrectedBits>maxCorrectedBits) id=-1;
+    return id;
+}
+
+
+
 /************************************
  *
  *
@@ -129,6 +288,7 @@ cv::Mat  FiducidalMarkers::createBoardImage( Size gridSize,int MarkerSize,int Ma
             marker.copyTo(subrect);
         }
 
+    TInfo.updateIdIndex();
     return tableImage;
 }
 
@@ -187,6 +347,7 @@ cv::Mat  FiducidalMarkers::createBoardImage_ChessBoard( Size gridSize,int Marker
         }
     }
 
+    TInfo.updateIdIndex();
     return tableImage;
 }
 
@@ -240,6 +401,7 @@ cv::Mat  FiducidalMarkers::createBoardImage_Frame( Size gridSize,int MarkerSize,
         }
     }
 
+    TInfo.updateIdIndex();
     return tableImage;
 }
 /************************************
@@ -269,55 +431,9 @@ Mat FiducidalMarkers::rotate(const Mat  &in)
  *
  *
  ************************************/
-int FiducidalMarkers::hammDistMarker(Mat  bits)
-{
-    int ids[4][5]=
-    {
-        {
-            1,0,0,0,0
-        }
-        ,
-        {
-            1,0,1,1,1
-        }
-        ,
-        {
-            0,1,0,0,1
-        }
-        ,
-        {
-            0, 1, 1, 1, 0
-        }
-    };
-    int dist=0;
-
-    for (int y=0;y<5;y++)
-    {
-        int minSum=1e5;
-        //hamming distance to each possible word
-        for (int p=0;p<4;p++)
-        {
-            int sum=0;
-            //now, count
-            for (int x=0;x<5;x++)
-                sum+=  bits.at<uchar>(y,x) == ids[p][x]?0:1;
-            if (minSum>sum) minSum=sum;
-        }
-        //do the and
-        dist+=minSum;
-    }
-
-    return dist;
-}
-
-/************************************
- *
- *
- *
- *
- ************************************/
-int FiducidalMarkers::analyzeMarkerImage(Mat &grey,int &nRotations)
+int FiducidalMarkers::analyzeMarkerImage(Mat &grey,int &nRotations,int maxCorrectedBits,int &nCorrectedBits)
 {
+    nCorrectedBits=0;
 
     //Markers  are divided in 7x7 regions, of which the inner 5x5 belongs to marker info
     //the external border shoould be entirely black
@@ -340,11 +456,8 @@ int FiducidalMarkers::analyzeMarkerImage(Mat &grey,int &nRotations)
         }
     }
 
-    //now,
-    vector<int> markerInfo(5);
-    Mat _bits=Mat::zeros(5,5,CV_8UC1);
     //get information(for each inner square, determine if it is  black or white)
-
+    unsigned int code=0;
     for (int y=0;y<5;y++)
     {
 
@@ -354,99 +467,52 @@ int FiducidalMarkers::analyzeMarkerImage(Mat &grey,int &nRotations)
             int Ystart=(y+1)*(swidth);
             Mat square=grey(Rect(Xstart,Ystart,swidth,swidth));
             int nZ=countNonZero(square);
-            if (nZ> (swidth*swidth) /2)  _bits.at<uchar>( y,x)=1;
-        }
-    }
-// 		printMat<uchar>( _bits,"or mat");
-
-    //checkl all possible rotations
-    Mat _bitsFlip;
-    Mat Rotations[4];
-    Rotations[0]=_bits;
-    int dists[4];
-    dists[0]=hammDistMarker( Rotations[0]) ;
-    pair<int,int> minDist( dists[0],0);
-    for (int i=1;i<4;i++)
-    {
-        //rotate
-        Rotations[i]=rotate(Rotations[i-1]);
-        //get the hamming distance to the nearest possible word
-        dists[i]=hammDistMarker( Rotations[i]) ;
-        if (dists[i]<minDist.first)
-        {
-            minDist.first=  dists[i];
-            minDist.second=i;
-        }
-    }
-// 		        printMat<uchar>( Rotations [ minDist.second]);
-// 		 	cout<<"MinDist="<<minDist.first<<" "<<minDist.second<<endl;
-
-    nRotations=minDist.second;
-    if (minDist.first!=0)	 //FUTURE WORK: correct if any error
-        return -1;
-    else {//Get id of the marker
-        int MatID=0;
-        cv::Mat bits=Rotations [ minDist.second];
-        for (int y=0;y<5;y++)
-        {
-            MatID<<=1;
-            if ( bits.at<uchar>(y,1)) MatID|=1;
-            MatID<<=1;
-            if ( bits.at<uchar>(y,3)) MatID|=1;
+            code<<=1;
+            if (nZ> (swidth*swidth) /2)  code|=1;
         }
-        return MatID;
     }
+    return findMarkerCode(code,nRotations,maxCorrectedBits,nCorrectedBits);
 }
 
-
 /************************************
  *
  *
  *
  *
  ************************************/
-bool FiducidalMarkers::correctHammMarker(Mat &bits)
+int FiducidalMarkers::analyzeMarkerCells(const Mat &cells,int &nRotations,int maxCorrectedBits,int &nCorrectedBits)
 {
-    //detect this lines with errors
-    bool errors[4];
-    int ids[4][5]=
+    nCorrectedBits=0;
+    //the external border shoould be entirely black
+    for (int y=0;y<7;y++)
     {
+        const uchar *row=cells.ptr<uchar>(y);
+        int inc=6;
+        if (y==0 || y==6) inc=1;//for first and last row, check the whole border
+        for (int x=0;x<7;x+=inc)
         {
-            0,0,0,0,0
-        }
-        ,
-        {
-            0,0,1,1,1
-        }
-        ,
-        {
-            1,1,0,0,1
-        }
-        ,
-        {
-            1, 1, 1, 1, 0
+            if (row[x]!=0) {
+// 		cout<<"neb"<<endl;
+                return -1;//can not be a marker because the border element is not black!
+            }
         }
-    };
+    }
 
-    for (int y=0;y<5;y++)
+    //get information(the inner 5x5 cells)
+    unsigned int code=0;
+    for (int y=1;y<6;y++)
     {
-        int minSum=1e5;
-        //hamming distance to each possible word
-        for (int p=0;p<4;p++)
+        const uchar *row=cells.ptr<uchar>(y);
+        for (int x=1;x<6;x++)
         {
-            int sum=0;
-            //now, count
-            for (int x=0;x<5;x++)
-                sum+=  bits.at<uchar>(y,x) == ids[p][x]?0:1;
-            if (minSum>sum) minSum=sum;
+            code<<=1;
+            if (row[x]!=0) code|=1;
         }
-        if (minSum!=0) errors[y]=true;
-        else errors[y]=false;
     }
-
-    return true;
+    return findMarkerCode(code,nRotations,maxCorrectedBits,nCorrectedBits);
 }
 
+
 /************************************
  *
  *
@@ -454,6 +520,18 @@ bool FiducidalMarkers::correctHammMarker(Mat &bits)
  *
  ************************************/
 int FiducidalMarkers::detect(const Mat &in,int &nRotations)
+{
+    int nCorrectedBits;
+    return detect(in,nRotations,0,nCorrectedBits);
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+int FiducidalMarkers::detect(const Mat &in,int &nRotations,int maxCorrectedBits,int &nCorrectedBits)
 {
     assert(in.rows==in.cols);
     Mat grey;
@@ -465,7 +543,7 @@ int FiducidalMarkers::detect(const Mat &in,int &nRotations)
     //now, analyze the interior in order to get the id
     //try first with the big ones
 
-    return analyzeMarkerImage(grey,nRotations);;
+    return analyzeMarkerImage(grey,nRotations,maxCorrectedBits,nCorrectedBits);
     //too many false positives
     /*    int id=analyzeMarkerImage(grey,nRotations);
         if (id!=-1) return id;
@@ -474,6 +552,34 @@ int FiducidalMarkers::detect(const Mat &in,int &nRotations)
         return -1;*/
 }
 
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+int FiducidalMarkers::detectFromCells(const Mat &cells,int &nRotations)
+{
+    int nCorrectedBits;
+    return detectFromCells(cells,nRotations,0,nCorrectedBits);
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+int FiducidalMarkers::detectFromCells(const Mat &cells,int &nRotations,int maxCorrectedBits,int &nCorrectedBits)
+{
+    assert(cells.rows==7 && cells.cols==7 && cells.type()==CV_8UC1);
+    //threshold the cells (1 for white cells)
+    Mat bits;
+    threshold(cells, bits,125, 1, THRESH_BINARY|THRESH_OTSU);
+    return analyzeMarkerCells(bits,nRotations,maxCorrectedBits,nCorrectedBits);
+}
+
+
 vector<int> FiducidalMarkers::getListOfValidMarkersIds_random(int nMarkers,vector<int> *excluded) throw (cv::Exception)
 {
 
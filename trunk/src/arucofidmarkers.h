@@ -71,6 +71,29 @@ public:
      */
     static int detect(const cv::Mat &in,int &nRotations);
 
+    /** Detection of fiducidal aruco markers (10 bits) correcting errors in the bits read.
+     * The marker is identified as the one whose code (in any rotation) is nearest to the bits read, provided that the distance is not
+     * greater than maxCorrectedBits and that there is no other marker at the same distance. The look up is done in a table precomputed with
+     * all the codes up to one bit of error. The table for two bits is bigger and is built the first time it is required
+     * @param in input image with the patch that contains the possible marker
+     * @param nRotations number of 90deg rotations in clockwise direction needed to set the marker in correct position
+     * @param maxCorrectedBits maximum number of bits corrected (0,1 or 2)
+     * @param nCorrectedBits output number of bits corrected
+     * @return -1 if the image passed is a not a valid marker, and its id in case it really is a marker
+     */
+    static int detect(const cv::Mat &in,int &nRotations,int maxCorrectedBits,int &nCorrectedBits);
+
+    /** Detection of fiducidal aruco markers (10 bits) from the values of its cells (see MarkerDetector::setMarkerCellsDetectorFunction)
+     * @param cells 7x7 CV_8UC1 matrix with the mean grey value of each cell of the marker (border included)
+     * @param nRotations number of 90deg rotations in clockwise direction needed to set the marker in correct position
+     * @return -1 if the cells passed are not a valid marker, and its id in case it really is a marker
+     */
+    static int detectFromCells(const cv::Mat &cells,int &nRotations);
+
+    /** As detectFromCells, correcting up to maxCorrectedBits errors (see detect)
+     */
+    static int detectFromCells(const cv::Mat &cells,int &nRotations,int maxCorrectedBits,int &nCorrectedBits);
+
     /**Similar to createMarkerImage. Instead of returning a visible image, returns a 8UC1 matrix of 0s and 1s with the marker info
      */
     static cv::Mat getMarkerMat(int id) throw (cv::Exception);
@@ -109,9 +132,8 @@ private:
   
     static vector<int> getListOfValidMarkersIds_random(int nMarkers,vector<int> *excluded) throw (cv::Exception);
     static  cv::Mat rotate(const cv::Mat & in);
-    static  int hammDistMarker(cv::Mat  bits);
-    static  int analyzeMarkerImage(cv::Mat &grey,int &nRotations);
-    static  bool correctHammMarker(cv::Mat &bits);
+    static  int analyzeMarkerImage(cv::Mat &grey,int &nRotations,int maxCorrectedBits,int &nCorrectedBits);
+    static  int analyzeMarkerCells(const cv::Mat &cells,int &nRotations,int maxCorrectedBits,int &nCorrectedBits);
 };
 
 }
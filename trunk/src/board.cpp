@@ -27,6 +27,7 @@ or implied, of Rafael Muñoz Salinas.
 ********************************/
 #include "board.h"
 #include <fstream>
+#include <algorithm>
 using namespace std;
 using namespace cv;
 namespace aruco
@@ -39,6 +40,7 @@ namespace aruco
 BoardConfiguration::BoardConfiguration()
 {
     mInfoType=NONE;
+    _indexedSize=0;
 }
 /**
 *
@@ -48,6 +50,9 @@ BoardConfiguration::BoardConfiguration ( const BoardConfiguration  &T ): vector<
 {
 //     MarkersInfo=T.MarkersInfo;
     mInfoType=T.mInfoType;
+    _indexById=T._indexById;
+    _sortedIds=T._sortedIds;
+    _indexedSize=T._indexedSize;
 }
 
 /**
@@ -58,6 +63,9 @@ BoardConfiguration & BoardConfiguration ::operator=(const BoardConfiguration  &T
 //     MarkersInfo=T.MarkersInfo;
     vector<MarkerInfo>::operator=(T);
     mInfoType=T.mInfoType;
+    _indexById=T._indexById;
+    _sortedIds=T._sortedIds;
+    _indexedSize=T._indexedSize;
     return *this;
 }
 /**
@@ -127,26 +135,69 @@ void BoardConfiguration::readFromFile(cv::FileStorage &fs)throw (cv::Exception)
             at(i).push_back(point);
         }
     }
+    updateIdIndex();
+}
+
+/**
+ */
+void BoardConfiguration::updateIdIndex()
+{
+    _indexById.clear();
+    _sortedIds.clear();
+    int maxId=-1;
+    bool negative=false;
+    for (size_t i=0;i<size();i++) {
+        maxId=std::max(maxId,at(i).id);
+        negative|=at(i).id<0;
+    }
+    //a dense table is employed unless the ids are too sparse (the ids of the markers of aruco are in [0,1023])
+    if (!negative && size_t(maxId)<16*size()+1024) {
+        _indexById.resize(maxId+1,-1);
+        for (size_t i=0;i<size();i++)
+            if (_indexById[at(i).id]==-1) _indexById[at(i).id]=i;
+    }
+    else {
+        _sortedIds.resize(size());
+        for (size_t i=0;i<size();i++) _sortedIds[i]=make_pair(at(i).id,int(i));
+        std::sort(_sortedIds.begin(),_sortedIds.end());
+    }
+    _indexedSize=size();
+}
+
+/**
+ */
+int BoardConfiguration::findInIdIndex(int id)const
+{
+    if (!_sortedIds.empty()) {
+        vector<pair<int,int> >::const_iterator it=std::lower_bound(_sortedIds.begin(),_sortedIds.end(),make_pair(id,-1));
+        return (it!=_sortedIds.end() && it->first==id)?it->second:-1;
+    }
+    if (id<0 || size_t(id)>=_indexById.size()) return -1;
+    return _indexById[id];
 }
 
 /**
  */
 int BoardConfiguration::getIndexOfMarkerId(int id)const
 {
- 
- for(size_t i=0;i<size();i++)
-   if( at(i).id==id)return i;
- return -1;   
+    //the table is not modified here, so that the searches can be done from several threads at once. If it is out of date
+    //(markers added or removed, or a hit whose id has been modified in place), the list is searched linearly
+    if (_indexedSize==size()) {
+        int idx=findInIdIndex(id);
+        if (idx==-1 || at(idx).id==id) return idx;
+    }
+    for (size_t i=0;i<size();i++)
+        if (at(i).id==id) return i;
+    return -1;
 }
 
 /**
  */
 const MarkerInfo& BoardConfiguration::getMarkerInfo(int id)const throw (cv::Exception)
 {
- for(size_t i=0;i<size();i++)
-   if( at(i).id ==id) return at(i);
+ int idx=getIndexOfMarkerId(id);
+ if (idx!=-1) return at(idx);
  throw cv::Exception(111,"BoardConfiguration::getMarkerInfo","Marker with the id given is not found",__FILE__,__LINE__);
-  
 }
 
 
@@ -100,7 +100,9 @@ public:
     bool isExpressedInPixels()const {
         return mInfoType==PIX;
     }
-    /**Returns the index of the marker with id indicated, if is in the list
+    /**Returns the index of the marker with id indicated, if is in the list.
+     * The search employs a table of indices by id (see updateIdIndex). If the number of markers has changed since it was built,
+     * the list is searched linearly instead. The table is never modified by the search, so that it can be done from several threads at once
      */
     int getIndexOfMarkerId(int id)const;
     /**Returns the Info of the marker with id specified. If not in the set, throws exception
@@ -109,7 +111,19 @@ public:
     /**Set in the list passed the set of the ids 
      */
     void getIdList(vector<int> &ids,bool append=true)const;
+    /**Rebuilds the table of indices by id employed by getIndexOfMarkerId and getMarkerInfo. It is done when the configuration
+     * is read or copied, so it must be called after adding, removing or changing the ids of the markers. Otherwise, the searches are
+     * slower (markers added or removed) or may not find the ids modified in place (the number of markers being the same)
+     */
+    void updateIdIndex();
 private:
+    //returns the index of the id in the table, or -1
+    int findInIdIndex(int id)const;
+    //table of indices by id: dense table if the ids are not too sparse, pairs (id,index) sorted by id otherwise.
+    //_indexedSize is the number of markers when the table was built
+    vector<int> _indexById;
+    vector<pair<int,int> > _sortedIds;
+    size_t _indexedSize;
     /**Saves the board info to a file
     */
     void saveToFile(cv::FileStorage &fs)throw (cv::Exception);
@@ -127,10 +141,15 @@ public:
     BoardConfiguration conf;
     //matrices of rotation and translation respect to the camera
     cv::Mat Rvec,Tvec;
+    //ids of the markers employed to calculate the pose. With the outlier rejection (see BoardDetector::setOutlierRejection), the markers rejected are not included
+    vector<int> inlierIds;
+    //root mean square reprojection error (in pixels) of the corners of the markers in inlierIds, -1 if the pose is not calculated
+    float reprojErr;
     /**
     */
     Board()
     {
+        reprojErr=-1;
         Rvec.create(3,1,CV_32FC1);
         Tvec.create(3,1,CV_32FC1);
         for (int i=0;i<3;i++)
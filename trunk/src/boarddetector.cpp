@@ -26,12 +26,15 @@ authors and should not be interpreted as representing official policies, either
 or implied, of Rafael Muñoz Salinas.
 ********************************/
 #include "boarddetector.h"
+#include "squareposesolver.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <cstdlib>
 #include <ctime>
 #include <cassert>
 #include <fstream>
+#include <limits>
+#include <algorithm>
 using namespace std;
 using namespace cv;
 namespace aruco
@@ -42,6 +45,51 @@ BoardDetector::BoardDetector(bool  setYPerperdicular)
 {
     _setYPerperdicular=setYPerperdicular;
     _areParamsSet=false;
+    _poseTracking=false;
+    _maxTrackingReprojErr=2;
+    _outlierRejection=false;
+    _outlierMaxReprojErr=3;
+    _outlierMaxIterations=20;
+    _outlierMaxTime=2;
+    _redetection=false;
+}
+/**
+*
+*
+*/
+void BoardDetector::setPoseTracking(bool enable,float maxReprojErr) {
+    _poseTracking=enable;
+    _maxTrackingReprojErr=maxReprojErr;
+    _prevPoses.clear();
+}
+/**
+*
+*
+*/
+void BoardDetector::setOutlierRejection(bool enable,float maxReprojErr,int maxIterations,float maxTime) {
+    _outlierRejection=enable;
+    _outlierMaxReprojErr=maxReprojErr;
+    _outlierMaxIterations=maxIterations<1?1:maxIterations;
+    _outlierMaxTime=maxTime;
+}
+/**
+*
+* Root mean square reprojection error of the corners of the markers indicated (4 consecutive rows of objPoints and imagePoints per marker)
+*/
+static double reprojectionError ( const Mat &objPoints,const Mat &imagePoints,const Mat &camMatrix,const Mat &distCoeff,const Mat &rvec,const Mat &tvec,const vector<char> &markers )
+{
+    vector<cv::Point2f> reprojected;
+    cv::projectPoints ( objPoints,rvec,tvec,camMatrix,distCoeff,reprojected );
+    double err=0;
+    int n=0;
+    for ( size_t i=0;i<reprojected.size();i++ )
+    {
+        if ( !markers[i/4] ) continue;
+        float dx=reprojected[i].x-imagePoints.at<float> ( i,0 ),dy=reprojected[i].y-imagePoints.at<float> ( i,1 );
+        err+=dx*dx+dy*dy;
+        n++;
+    }
+    return n==0?0:sqrt ( err/n );
 }
 /**
    * Use if you plan to let this class to perform marker detection too
@@ -71,8 +119,17 @@ float  BoardDetector::detect(const cv::Mat &im)throw (cv::Exception)
 
     float res;
 
-    if (_camParams.isValid())
+    if (_camParams.isValid()) {
         res=detect(_vmarkers,_bconf,_boardDetected,_camParams.CameraMatrix,_camParams.Distorsion,_markerSize);
+        //look for the markers missed where the pose says they are, and calculate the pose again with them
+        if (_redetection && _boardDetected.size()<_bconf.size()) {
+            vector<Marker> found;
+            if (detectMissingMarkers(im,_boardDetected,_camParams.CameraMatrix,_camParams.Distorsion,_markerSize,found)>0) {
+                _vmarkers.insert(_vmarkers.end(),found.begin(),found.end());
+                res=detect(_vmarkers,_bconf,_boardDetected,_camParams.CameraMatrix,_camParams.Distorsion,_markerSize);
+            }
+        }
+    }
     else res=detect(_vmarkers,_bconf,_boardDetected);
     return res;
 }
@@ -80,6 +137,115 @@ float  BoardDetector::detect(const cv::Mat &im)throw (cv::Exception)
 *
 *
 */
+int BoardDetector::detectMissingMarkers ( const cv::Mat &im,const Board &Bdetected,cv::Mat camMatrix,cv::Mat distCoeff,float markerSizeMeters,vector<Marker> &found ) throw ( cv::Exception )
+{
+    //minimum side (in pixels) of the projected markers that are analyzed
+    const float minSide=10;
+    found.clear();
+    const BoardConfiguration &BConf=Bdetected.conf;
+    if ( Bdetected.size() ==0 || Bdetected.reprojErr<0 || BConf.size() ==0 ) return 0;
+    double marker_meter_per_pix=1;
+    if ( BConf.mInfoType==BoardConfiguration::PIX )
+    {
+        if ( markerSizeMeters<=0 ) return 0;
+        marker_meter_per_pix=markerSizeMeters /  cv::norm ( BConf[0][0]-BConf[0][1] );
+    }
+    //markers of the configuration that have not been detected
+    vector<char> detected ( BConf.size(),0 );
+    for ( size_t i=0;i<Bdetected.size();i++ )
+    {
+        int idx=BConf.getIndexOfMarkerId ( Bdetected[i].id );
+        if ( idx!=-1 ) detected[idx]=1;
+    }
+    vector<int> missing;
+    for ( size_t i=0;i<BConf.size();i++ )
+        if ( !detected[i] ) missing.push_back ( i );
+    if ( missing.size() ==0 ) return 0;
+
+    //pose of the board as given by solvePnP, i.e., undoing rotateXAxis
+    Mat R;
+    Rodrigues ( Bdetected.Rvec,R );
+    R.convertTo ( R,CV_64F );
+    if ( _setYPerperdicular )
+    {
+        Mat Rraw=R.clone();
+        for ( int r=0;r<3;r++ )
+        {
+            Rraw.at<double> ( r,1 ) =R.at<double> ( r,2 );
+            Rraw.at<double> ( r,2 ) =-R.at<double> ( r,1 );
+        }
+        R=Rraw;
+    }
+    Mat rvec,tvec;
+    Rodrigues ( R,rvec );
+    Bdetected.Tvec.convertTo ( tvec,CV_64F );
+    //the markers behind the camera are discarded, and the rest projected
+    vector<int> candidates;
+    vector<cv::Point3f> objPoints;
+    for ( size_t m=0;m<missing.size();m++ )
+    {
+        const aruco::MarkerInfo &Minfo=BConf[missing[m]];
+        bool inFront=true;
+        for ( int p=0;p<4 && inFront;p++ )
+            inFront=R.at<double> ( 2,0 ) *Minfo[p].x*marker_meter_per_pix+R.at<double> ( 2,1 ) *Minfo[p].y*marker_meter_per_pix+
+                    R.at<double> ( 2,2 ) *Minfo[p].z*marker_meter_per_pix+tvec.at<double> ( 2,0 ) >0;
+        if ( !inFront ) continue;
+        candidates.push_back ( missing[m] );
+        for ( int p=0;p<4;p++ ) objPoints.push_back ( cv::Point3f ( Minfo[p].x*marker_meter_per_pix,Minfo[p].y*marker_meter_per_pix,Minfo[p].z*marker_meter_per_pix ) );
+    }
+    if ( candidates.size() ==0 ) return 0;
+    if ( distCoeff.total() ==0 ) distCoeff=cv::Mat::zeros ( 1,4,CV_32FC1 );
+    vector<cv::Point2f> projected;
+    cv::projectPoints ( Mat ( objPoints ),rvec,tvec,camMatrix,distCoeff,projected );
+
+    //the regions must be inside the image, not too small, and facing the camera (same orientation than the markers detected)
+    const Marker &ref=Bdetected[0];
+    float refOrientation= ( ref[1].x-ref[0].x ) * ( ref[2].y-ref[0].y )- ( ref[1].y-ref[0].y ) * ( ref[2].x-ref[0].x );
+    vector<vector<cv::Point2f> > regions;
+    vector<int> regionIdx;
+    for ( size_t m=0;m<candidates.size();m++ )
+    {
+        vector<cv::Point2f> quad ( projected.begin() +4*m,projected.begin() +4*m+4 );
+        bool valid=true;
+        for ( int p=0;p<4 && valid;p++ )
+            valid=quad[p].x>=1 && quad[p].y>=1 && quad[p].x<im.cols-1 && quad[p].y<im.rows-1 && cv::norm ( quad[p]-quad[ ( p+1 ) %4] ) >=minSide;
+        float orientation= ( quad[1].x-quad[0].x ) * ( quad[2].y-quad[0].y )- ( quad[1].y-quad[0].y ) * ( quad[2].x-quad[0].x );
+        if ( !valid || orientation*refOrientation<=0 ) continue;
+        regions.push_back ( quad );
+        regionIdx.push_back ( candidates[m] );
+    }
+    if ( regions.size() ==0 ) return 0;
+
+    //identify the regions. A marker is accepted only if it has the id expected and its first corner where expected
+    if ( im.type() ==CV_8UC3 ) cv::cvtColor ( im,_grey,CV_BGR2GRAY );
+    else _grey=im;
+    int nRegions=regions.size(),nThreads=_mdetector.getNumThreads();
+    vector<Marker> markers ( nRegions );
+    vector<char> valid ( nRegions,0 );
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(nThreads) schedule(dynamic) if(nThreads>1)
+#endif
+    for ( int r=0;r<nRegions;r++ )
+    {
+        if ( !_mdetector.identifyMarker ( _grey,regions[r],markers[r] ) ) continue;
+        float side=cv::norm ( regions[r][0]-regions[r][1] );
+        valid[r]=markers[r].id==BConf[regionIdx[r]].id && cv::norm ( markers[r][0]-regions[r][0] ) <side/4;
+    }
+    for ( int r=0;r<nRegions;r++ )
+        if ( valid[r] ) found.push_back ( markers[r] );
+    return found.size();
+}
+/**
+*
+*
+*/
+void BoardDetector::setRedetection(bool enable) {
+    _redetection=enable;
+}
+/**
+*
+*
+*/
 float BoardDetector::detect ( const vector<Marker> &detectedMarkers,const  BoardConfiguration &BConf, Board &Bdetected,const CameraParameters &cp, float markerSizeMeters ) throw ( cv::Exception )
 {
     return detect ( detectedMarkers, BConf,Bdetected,cp.CameraMatrix,cp.Distorsion,markerSizeMeters );
@@ -102,6 +268,8 @@ float BoardDetector::detect ( const vector<Marker> &detectedMarkers,const  Board
 
     // cout<<"markerSizeMeters="<<markerSizeMeters<<endl;
     Bdetected.clear();
+    Bdetected.inlierIds.clear();
+    Bdetected.reprojErr=-1;
     ///find among detected markers these that belong to the board configuration
     for ( unsigned int i=0;i<detectedMarkers.size();i++ )
     {
@@ -143,11 +311,11 @@ float BoardDetector::detect ( const vector<Marker> &detectedMarkers,const  Board
         {
             int idx=Bdetected.conf.getIndexOfMarkerId(Bdetected[i].id);
             assert(idx!=-1);
+            const aruco::MarkerInfo &Minfo=Bdetected.conf[idx];
             for ( int p=0;p<4;p++ )
             {
                 imagePoints.at<float> ( ( i*4 ) +p,0 ) =Bdetected[i][p].x;
                 imagePoints.at<float> ( ( i*4 ) +p,1 ) =Bdetected[i][p].y;
-                const aruco::MarkerInfo &Minfo=Bdetected.conf.getMarkerInfo( Bdetected[i].id);
 
                 objPoints.at<float> ( ( i*4 ) +p,0 ) = Minfo[p].x*marker_meter_per_pix;
                 objPoints.at<float> ( ( i*4 ) +p,1 ) = Minfo[p].y*marker_meter_per_pix;
@@ -158,7 +326,43 @@ float BoardDetector::detect ( const vector<Marker> &detectedMarkers,const  Board
         if (distCoeff.total()==0) distCoeff=cv::Mat::zeros(1,4,CV_32FC1 );
 
         cv::Mat rvec,tvec;
-        cv::solvePnP(objPoints,imagePoints,camMatrix,distCoeff,rvec,tvec );
+        bool solved=false;
+        std::map<int,std::pair<cv::Mat,cv::Mat> >::iterator prev=_prevPoses.find(BConf[0].id);
+        bool hasPrev=_poseTracking && prev!=_prevPoses.end();
+        vector<char> inliers ( Bdetected.size(),1 );
+        if ( _outlierRejection && Bdetected.size() >1 &&
+                estimateRobustPose ( objPoints,imagePoints,camMatrix,distCoeff,hasPrev?&prev->second:NULL,rvec,tvec,inliers ) )
+        {
+            //refine the pose with the corners of the inliers
+            int nInliers=0;
+            for ( size_t i=0;i<inliers.size();i++ ) nInliers+=inliers[i];
+            Mat objInliers ( 4*nInliers,3,CV_32FC1 ),imageInliers ( 4*nInliers,2,CV_32FC1 );
+            for ( size_t i=0,k=0;i<inliers.size();i++ )
+            {
+                if ( !inliers[i] ) continue;
+                for ( int p=0;p<4;p++,k++ )
+                {
+                    Mat objRow=objInliers.row ( k ),imageRow=imageInliers.row ( k );
+                    objPoints.row ( i*4+p ).copyTo ( objRow );
+                    imagePoints.row ( i*4+p ).copyTo ( imageRow );
+                }
+            }
+            cv::solvePnP(objInliers,imageInliers,camMatrix,distCoeff,rvec,tvec,true );
+            solved=true;
+        }
+        if ( !solved && hasPrev )
+        {
+            //start from the pose of the previous call, and check that it has converged to a valid solution
+            prev->second.first.copyTo ( rvec );
+            prev->second.second.copyTo ( tvec );
+            cv::solvePnP(objPoints,imagePoints,camMatrix,distCoeff,rvec,tvec,true );
+            solved=reprojectionError ( objPoints,imagePoints,camMatrix,distCoeff,rvec,tvec,inliers ) <=_maxTrackingReprojErr;
+        }
+        if ( !solved ) cv::solvePnP(objPoints,imagePoints,camMatrix,distCoeff,rvec,tvec );
+        if ( _poseTracking ) _prevPoses[BConf[0].id]=std::make_pair ( rvec.clone(),tvec.clone() );
+        Bdetected.reprojErr=reprojectionError ( objPoints,imagePoints,camMatrix,distCoeff,rvec,tvec,inliers );
+        for ( size_t i=0;i<Bdetected.size();i++ )
+            if ( inliers[i] ) Bdetected.inlierIds.push_back ( Bdetected[i].id );
         rvec.convertTo(Bdetected.Rvec,CV_32FC1);
         tvec.convertTo(Bdetected.Tvec,CV_32FC1);
         //now, rotate 90 deg in X so that Y axis points up
@@ -167,11 +371,158 @@ float BoardDetector::detect ( const vector<Marker> &detectedMarkers,const  Board
 //         cout<<Bdetected.Rvec.at<float>(0,0)<<" "<<Bdetected.Rvec.at<float>(1,0)<<" "<<Bdetected.Rvec.at<float>(2,0)<<endl;
 //         cout<<Bdetected.Tvec.at<float>(0,0)<<" "<<Bdetected.Tvec.at<float>(1,0)<<" "<<Bdetected.Tvec.at<float>(2,0)<<endl;
     }
+    else _prevPoses.erase ( BConf[0].id );
 
     float prob=float( Bdetected.size() ) /double ( Bdetected.conf.size() );
     return prob;
 }
 
+/**
+*
+* Robust estimation of the pose of the board: each marker gives two hypotheses of the pose, which are scored by the number of markers that agree with them
+*/
+//number of markers whose corners reproject with the pose (R,t) with a mean error below maxErr (in pixels), and sum of their errors
+static int scorePose ( const double R[9],const double t[3],const vector<cv::Point3d> &obj,const vector<cv::Point2d> &img,double fx,double fy,double maxErr,vector<char> &inliers,double &sumErr )
+{
+    int nInliers=0;
+    sumErr=0;
+    for ( size_t i=0;i<inliers.size();i++ )
+    {
+        double err=0;
+        for ( int p=0;p<4;p++ )
+        {
+            const cv::Point3d &X=obj[i*4+p];
+            double qx=R[0]*X.x+R[1]*X.y+R[2]*X.z+t[0];
+            double qy=R[3]*X.x+R[4]*X.y+R[5]*X.z+t[1];
+            double qz=R[6]*X.x+R[7]*X.y+R[8]*X.z+t[2];
+            if ( qz<=0 ) {err=std::numeric_limits<double>::max();break;}
+            double dx=fx* ( qx/qz-img[i*4+p].x ),dy=fy* ( qy/qz-img[i*4+p].y );
+            err+=sqrt ( dx*dx+dy*dy ) /4.;
+        }
+        inliers[i]=err<maxErr;
+        if ( inliers[i] )
+        {
+            nInliers++;
+            sumErr+=err;
+        }
+    }
+    return nInliers;
+}
+
+bool BoardDetector::estimateRobustPose ( const Mat &objPoints,const Mat &imagePoints,Mat camMatrix,Mat distCoeff,const std::pair<cv::Mat,cv::Mat> *previous,Mat &rvec,Mat &tvec,vector<char> &inliers )
+{
+    int64 startTick=getTickCount();
+    double maxTicks=_outlierMaxTime*1e-3*getTickFrequency();
+    int nMarkers=objPoints.rows/4;
+    Mat K;
+    camMatrix.convertTo ( K,CV_64F );
+    double fx=K.at<double> ( 0,0 ),fy=K.at<double> ( 1,1 ),cx=K.at<double> ( 0,2 ),cy=K.at<double> ( 1,2 );
+    //undistorted normalized coordinates of the corners, and their object points
+    vector<cv::Point2d> img ( 4*nMarkers );
+    vector<cv::Point3d> obj ( 4*nMarkers );
+    if ( countNonZero ( distCoeff ) !=0 )
+    {
+        Mat undistorted;
+        undistortPoints ( imagePoints.reshape ( 2 ),undistorted,camMatrix,distCoeff );
+        for ( int i=0;i<4*nMarkers;i++ )
+            img[i]=cv::Point2d ( undistorted.at<cv::Point2f> ( i,0 ).x,undistorted.at<cv::Point2f> ( i,0 ).y );
+    }
+    else
+        for ( int i=0;i<4*nMarkers;i++ )
+            img[i]=cv::Point2d ( ( imagePoints.at<float> ( i,0 )-cx ) /fx, ( imagePoints.at<float> ( i,1 )-cy ) /fy );
+    for ( int i=0;i<4*nMarkers;i++ )
+        obj[i]=cv::Point3d ( objPoints.at<float> ( i,0 ),objPoints.at<float> ( i,1 ),objPoints.at<float> ( i,2 ) );
+
+    double bestR[9],bestT[3],bestErr=0;
+    int bestInliers=0;
+    vector<char> hypInliers ( nMarkers );
+    //the pose of the previous call is tried first
+    if ( previous!=NULL )
+    {
+        Mat rv,Rm;
+        previous->first.convertTo ( rv,CV_64F );
+        Rodrigues ( rv,Rm );
+        double R[9],t[3],err;
+        for ( int i=0;i<9;i++ ) R[i]=Rm.at<double> ( i/3,i%3 );
+        for ( int i=0;i<3;i++ ) t[i]=previous->second.at<double> ( i,0 );
+        int n=scorePose ( R,t,obj,img,fx,fy,_outlierMaxReprojErr,hypInliers,err );
+        if ( n>0 )
+        {
+            std::copy ( R,R+9,bestR );
+            std::copy ( t,t+3,bestT );
+            bestInliers=n;
+            bestErr=err;
+            inliers=hypInliers;
+        }
+    }
+    //the largest markers give the most accurate poses
+    vector<pair<double,int> > order ( nMarkers );
+    for ( int i=0;i<nMarkers;i++ )
+    {
+        double perimeter=0;
+        for ( int p=0;p<4;p++ )
+        {
+            float dx=imagePoints.at<float> ( i*4+p,0 )-imagePoints.at<float> ( i*4+ ( p+1 ) %4,0 );
+            float dy=imagePoints.at<float> ( i*4+p,1 )-imagePoints.at<float> ( i*4+ ( p+1 ) %4,1 );
+            perimeter+=sqrt ( dx*dx+dy*dy );
+        }
+        order[i]=make_pair ( -perimeter,i );
+    }
+    std::sort ( order.begin(),order.end() );
+
+    int nIterations=std::min ( nMarkers,_outlierMaxIterations );
+    for ( int it=0;it<nIterations && bestInliers<nMarkers;it++ )
+    {
+        if ( ( it>0 || previous!=NULL ) && getTickCount()-startTick>maxTicks ) break;
+        int m=order[it].second;
+        //frame of the marker in the board: origin in its center, x axis from corner 0 to 3 and y axis from corner 0 to 1 (see Marker::calculateExtrinsics)
+        const cv::Point3d *B=&obj[m*4];
+        cv::Point3d c= ( B[0]+B[1]+B[2]+B[3] ) *0.25;
+        cv::Point3d ex=B[3]-B[0],ey=B[1]-B[0];
+        double side=norm ( ey );
+        ex*=1./norm ( ex );
+        ey-=ex* ( ex.x*ey.x+ex.y*ey.y+ex.z*ey.z );
+        ey*=1./norm ( ey );
+        cv::Point3d ez ( ex.y*ey.z-ex.z*ey.y,ex.z*ey.x-ex.x*ey.z,ex.x*ey.y-ex.y*ey.x );
+        double u[4],v[4];
+        for ( int p=0;p<4;p++ )
+        {
+            u[p]=img[m*4+p].x;
+            v[p]=img[m*4+p].y;
+        }
+        SquarePoseSolver::Pose sol[2];
+        if ( !SquarePoseSolver::solveNormalized ( u,v,side,fx,fy,sol[0],sol[1] ) ) continue;
+        for ( int s=0;s<2;s++ )
+        {
+            //pose of the board: R=Rmarker*Rboard_marker^T, t=tmarker-R*c
+            double R[9],t[3],err;
+            const double *Rm=sol[s].R;
+            for ( int r=0;r<3;r++ )
+            {
+                R[r*3]  =Rm[r*3]*ex.x+Rm[r*3+1]*ey.x+Rm[r*3+2]*ez.x;
+                R[r*3+1]=Rm[r*3]*ex.y+Rm[r*3+1]*ey.y+Rm[r*3+2]*ez.y;
+                R[r*3+2]=Rm[r*3]*ex.z+Rm[r*3+1]*ey.z+Rm[r*3+2]*ez.z;
+                t[r]=sol[s].t[r]- ( R[r*3]*c.x+R[r*3+1]*c.y+R[r*3+2]*c.z );
+            }
+            int n=scorePose ( R,t,obj,img,fx,fy,_outlierMaxReprojErr,hypInliers,err );
+            if ( n>bestInliers || ( n==bestInliers && n>0 && err<bestErr ) )
+            {
+                std::copy ( R,R+9,bestR );
+                std::copy ( t,t+3,bestT );
+                bestInliers=n;
+                bestErr=err;
+                inliers=hypInliers;
+            }
+        }
+    }
+    if ( bestInliers==0 ) return false;
+    Mat Rm ( 3,3,CV_64F,bestR );
+    Rodrigues ( Rm,rvec );
+    tvec.create ( 3,1,CV_64F );
+    for ( int i=0;i<3;i++ ) tvec.at<double> ( i,0 ) =bestT[i];
+    return true;
+}
+
 void BoardDetector::rotateXAxis ( Mat &rotation )
 {
     cv::Mat R ( 3,3,CV_32FC1 );
@@ -28,6 +28,7 @@ or implied, of Rafael Muñoz Salinas.
 #ifndef _Aruco_BoardDetector_H
 #define _Aruco_BoardDetector_H
 #include <opencv2/opencv.hpp>
+#include <map>
 #include "exports.h"
 #include "board.h"
 #include "cameraparameters.h"
@@ -115,6 +116,56 @@ public:
      * So, to achieve this change, we have to rotate the X axis.
      */
     void setYPerperdicular(bool enable){_setYPerperdicular=enable;}
+
+    /**Enables the pose tracking, intended for sequences. The pose of a board in the previous call is employed as the initial
+     * guess of cv::solvePnP (useExtrinsicGuess), so that it converges in fewer iterations and with less jitter. If the reprojection
+     * error of the result is above maxReprojErr, the pose is solved again without the guess.
+     * The poses are kept per board, identified by the id of its first marker. A board that is not found in a call is forgotten.
+     * @param enable enables/disables the pose tracking
+     * @param maxReprojErr maximum root mean square reprojection error (in pixels) of the pose obtained from the guess
+     */
+    void setPoseTracking(bool enable,float maxReprojErr=2);
+    /**Indicates if the pose tracking is enabled
+     */
+    bool getPoseTracking()const{return _poseTracking;}
+
+    /**Enables the rejection of the markers that are not consistent with the pose of the board (e.g., a marker with a wrong id
+     * or badly refined corners), which would spoil it. A pose of the board is derived from each marker (the two solutions of
+     * SquarePoseSolver, from the largest markers first), and the markers whose corners reproject with it below maxReprojErr are its
+     * inliers. The pose with most inliers is refined with cv::solvePnP on them, and the ids of the inliers are given in Board::inlierIds.
+     * With pose tracking, the pose of the previous call is also tried. The number of markers tried is bounded by maxIterations and maxTime,
+     * so that the time employed is predictable (at least one is tried).
+     * @param enable enables/disables the outlier rejection
+     * @param maxReprojErr maximum mean reprojection error (in pixels) of the corners of an inlier
+     * @param maxIterations maximum number of markers from which a pose of the board is derived
+     * @param maxTime maximum time (in milliseconds) employed deriving and scoring the poses
+     */
+    void setOutlierRejection(bool enable,float maxReprojErr=3,int maxIterations=20,float maxTime=2);
+    /**Indicates if the outlier rejection is enabled
+     */
+    bool getOutlierRejection()const{return _outlierRejection;}
+
+    /**Enables the search of the markers of the board missed by the marker detector, in detect(const cv::Mat &). Once the pose
+     * of the board is calculated, the markers of the configuration not detected are projected in the image, and each projected
+     * region is identified with MarkerDetector::identifyMarker, without a second detection in the whole image.
+     * The markers recovered are added to the detected ones and the pose is calculated again.
+     * @param enable enables/disables the search
+     */
+    void setRedetection(bool enable);
+    /**Indicates if the search of the markers missed is enabled
+     */
+    bool getRedetection()const{return _redetection;}
+    /**Searches the markers of a board that were not detected, in the regions of the image where they are expected according to the
+     * pose of the board (see setRedetection). The internal marker detector is employed to identify them.
+     * @param im image where the markers were detected (CV_8UC1 or CV_8UC3)
+     * @param Bdetected board detected by this object, with its pose
+     * @param camMatrix intrinsic camera information.
+     * @param distCoeff camera distorsion coefficient. If set Mat() if is assumed no camera distorion
+     * @param markerSizeMeters size of the marker sides expressed in meters
+     * @param found output markers found, with their corners refined
+     * @return number of markers found
+     */
+    int detectMissingMarkers(const cv::Mat &im,const Board &Bdetected,cv::Mat camMatrix,cv::Mat distCoeff,float markerSizeMeters,vector<Marker> &found)throw (cv::Exception);
     
     
     
@@ -122,6 +173,21 @@ public:
 private:
     void rotateXAxis(cv::Mat &rotation);
     bool _setYPerperdicular;
+    //pose tracking: poses of the boards in the previous call (as given by solvePnP), by the id of their first marker
+    bool _poseTracking;
+    float _maxTrackingReprojErr;
+    std::map<int,std::pair<cv::Mat,cv::Mat> > _prevPoses;
+    //outlier rejection
+    bool _outlierRejection;
+    float _outlierMaxReprojErr;
+    int _outlierMaxIterations;
+    float _outlierMaxTime;
+    //finds the pose with most inlier markers (see setOutlierRejection). Returns false if no pose is found
+    bool estimateRobustPose(const cv::Mat &objPoints,const cv::Mat &imagePoints,cv::Mat camMatrix,cv::Mat distCoeff,const std::pair<cv::Mat,cv::Mat> *previous,
+                            cv::Mat &rvec,cv::Mat &tvec,vector<char> &inliers);
+    //search of the markers missed
+    bool _redetection;
+    cv::Mat _grey;
     
     //-- Functionality to detect markers inside
     bool _areParamsSet;
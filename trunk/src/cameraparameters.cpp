@@ -26,6 +26,7 @@ authors and should not be interpreted as representing official policies, either
 or implied, of Rafael Muñoz Salinas.
 ********************************/
 #include "cameraparameters.h"
+#include "mutex.h"
 #include <fstream>
 #include <iostream>
 #include <opencv/cv.h>
@@ -53,6 +54,7 @@ CameraParameters::CameraParameters(const CameraParameters &CI) {
     CI.CameraMatrix.copyTo(CameraMatrix);
     CI.Distorsion.copyTo(Distorsion);
     CamSize=CI.CamSize;
+    _undistCache=CI._undistCache;
 }
 
 /**
@@ -61,6 +63,7 @@ CameraParameters & CameraParameters::operator=(const CameraParameters &CI) {
     CI.CameraMatrix.copyTo(CameraMatrix);
     CI.Distorsion.copyTo(Distorsion);
     CamSize=CI.CamSize;
+    _undistCache=CI._undistCache;
     return *this;
 }
 /**
@@ -178,6 +181,169 @@ void CameraParameters::resize(cv::Size size)throw(cv::Exception)
     CameraMatrix.at<float>(0,2)*=AxFactor;
     CameraMatrix.at<float>(1,1)*=AyFactor;
     CameraMatrix.at<float>(1,2)*=AyFactor;
+    CamSize=size;
+}
+
+/**
+ */
+bool CameraParameters::equals(const cv::Mat &cameraMatrix,const cv::Mat &distorsionCoeff,cv::Size size)const
+{
+    if (size!=CamSize || cameraMatrix.total()!=CameraMatrix.total() || distorsionCoeff.total()!=Distorsion.total()) return false;
+    cv::Mat K,D;
+    cameraMatrix.convertTo(K,CV_32FC1);
+    distorsionCoeff.convertTo(D,CV_32FC1);
+    for (size_t i=0;i<K.total();i++)
+        if (K.ptr<float>(0)[i]!=CameraMatrix.ptr<float>(0)[i]) return false;
+    for (size_t i=0;i<D.total();i++)
+        if (D.ptr<float>(0)[i]!=Distorsion.ptr<float>(0)[i]) return false;
+    return true;
+}
+
+//protects the undistortion caches of all the objects. It is constructed before main, so that its initialization is not raced by the threads
+static Mutex undistortionCacheMutex;
+
+/**
+ */
+cv::Ptr<CameraParameters::UndistortionCache> CameraParameters::getUndistortionCache()const throw(cv::Exception)
+{
+    if (!isValid()) throw cv::Exception(9007,"invalid object","CameraParameters::getUndistortionCache",__FILE__,__LINE__);
+    cv::Ptr<UndistortionCache> cache;
+    //the parameters are public, so that they are compared with these of the cache instead of relying on the setters
+    {
+        ScopedLock lock(undistortionCacheMutex);
+        if (_undistCache.empty() || !equals(_undistCache->cameraMatrix,_undistCache->distorsion,_undistCache->size)) {
+            _undistCache=new UndistortionCache;
+            CameraMatrix.copyTo(_undistCache->cameraMatrix);
+            Distorsion.copyTo(_undistCache->distorsion);
+            _undistCache->size=CamSize;
+            _undistCache->tableStep=4;
+        }
+        cache=_undistCache;
+    }
+    return cache;
+}
+
+/**
+ */
+void CameraParameters::undistortPoints(const vector<cv::Point2f> &points,vector<cv::Point2f> &undistorted)const throw(cv::Exception)
+{
+    cv::Ptr<UndistortionCache> cache=getUndistortionCache();
+    float fx=CameraMatrix.at<float>(0,0),fy=CameraMatrix.at<float>(1,1),cx=CameraMatrix.at<float>(0,2),cy=CameraMatrix.at<float>(1,2);
+    int step=cache->tableStep;
+    cv::Mat table;
+    //the table is built once, by the first thread that needs it. Then it is only read
+    {
+        ScopedLock lock(undistortionCacheMutex);
+        if (cache->table.empty()) {
+            //the grid covers the whole image, the last row and column being at or beyond its border.
+            //The distortion is smooth, so that the error of the bilinear interpolation is negligible for a step of a few pixels
+            int cols=(CamSize.width-1)/step+2,rows=(CamSize.height-1)/step+2;
+            cv::Mat grid(rows*cols,1,CV_32FC2),und;
+            for (int y=0;y<rows;y++)
+                for (int x=0;x<cols;x++)
+                    grid.at<cv::Point2f>(y*cols+x,0)=cv::Point2f(x*step,y*step);
+            cv::undistortPoints(grid,und,CameraMatrix,Distorsion);
+            cv::Mat newTable(rows,cols,CV_32FC2);
+            for (int y=0;y<rows;y++)
+                for (int x=0;x<cols;x++) {
+                    const cv::Point2f &p=und.at<cv::Point2f>(y*cols+x,0);
+                    newTable.at<cv::Point2f>(y,x)=cv::Point2f(p.x*fx+cx,p.y*fy+cy);
+                }
+            cache->table=newTable;
+        }
+        table=cache->table;
+    }
+    undistorted.resize(points.size());
+    vector<int> outside;
+    for (size_t i=0;i<points.size();i++) {
+        float gx=points[i].x/step,gy=points[i].y/step;
+        int x=cvFloor(gx),y=cvFloor(gy);
+        if (x<0 || y<0 || x>=table.cols-1 || y>=table.rows-1) {
+            outside.push_back(i);
+            continue;
+        }
+        float ax=gx-x,ay=gy-y;
+        const cv::Point2f *row0=table.ptr<cv::Point2f>(y),*row1=table.ptr<cv::Point2f>(y+1);
+        undistorted[i]=(row0[x]*(1-ax)+row0[x+1]*ax)*(1-ay)+(row1[x]*(1-ax)+row1[x+1]*ax)*ay;
+    }
+    if (outside.size()>0) {
+        cv::Mat pts(outside.size(),1,CV_32FC2),und;
+        for (size_t i=0;i<outside.size();i++) pts.at<cv::Point2f>(i,0)=points[outside[i]];
+        cv::undistortPoints(pts,und,CameraMatrix,Distorsion);
+        for (size_t i=0;i<outside.size();i++) {
+            const cv::Point2f &p=und.at<cv::Point2f>(i,0);
+            undistorted[outside[i]]=cv::Point2f(p.x*fx+cx,p.y*fy+cy);
+        }
+    }
+}
+
+/**
+ */
+void CameraParameters::getUndistortionMaps(cv::Mat &map1,cv::Mat &map2,const cv::Mat &newCameraMatrix,cv::Size size,int m1type)const throw(cv::Exception)
+{
+    getUndistortionMaps(map1,map2,newCameraMatrix,-1,size,m1type);
+}
+
+/**
+ */
+void CameraParameters::getOptimalUndistortionMaps(cv::Mat &map1,cv::Mat &map2,double alpha,cv::Mat &newCameraMatrix,cv::Size size,int m1type)const throw(cv::Exception)
+{
+    if (alpha<0 || alpha>1) throw cv::Exception(9007,"alpha must be in [0,1]","CameraParameters::getOptimalUndistortionMaps",__FILE__,__LINE__);
+    getUndistortionMaps(map1,map2,cv::Mat(),alpha,size,m1type,&newCameraMatrix);
+}
+
+/**
+ */
+void CameraParameters::getUndistortionMaps(cv::Mat &map1,cv::Mat &map2,const cv::Mat &newCameraMatrix,double alpha,cv::Size size,int m1type,cv::Mat *usedCameraMatrix)const throw(cv::Exception)
+{
+    if (m1type!=CV_16SC2 && m1type!=CV_32FC1) throw cv::Exception(9007,"m1type must be CV_16SC2 or CV_32FC1","CameraParameters::getUndistortionMaps",__FILE__,__LINE__);
+    if (!newCameraMatrix.empty() && (newCameraMatrix.rows!=3 || newCameraMatrix.cols!=3))
+        throw cv::Exception(9007,"newCameraMatrix must be 3x3","CameraParameters::getUndistortionMaps",__FILE__,__LINE__);
+    cv::Ptr<UndistortionCache> cache=getUndistortionCache();
+    if (size.width<=0 || size.height<=0) size=CamSize;
+    //the maps are identified by the output size, the type and either alpha or the output camera matrix
+    cv::Mat K;
+    if (alpha<0) {
+        if (newCameraMatrix.empty()) CameraMatrix.copyTo(K);
+        else newCameraMatrix.convertTo(K,CV_32FC1);
+    }
+    bool found=false;
+    {
+        ScopedLock lock(undistortionCacheMutex);
+        for (size_t i=0;i<cache->maps.size() && !found;i++) {
+            const RemapMaps &m=cache->maps[i];
+            if (m.size!=size || m.m1type!=m1type || m.alpha!=alpha) continue;
+            if (alpha<0 && cv::norm(m.cameraMatrix,K,cv::NORM_INF)!=0) continue;
+            map1=m.map1;
+            map2=m.map2;
+            if (usedCameraMatrix!=NULL) *usedCameraMatrix=m.cameraMatrix.clone();
+            found=true;
+        }
+        //the maps are computed while the lock is held, so that two threads do not compute the same ones
+        if (!found) {
+            RemapMaps m;
+            m.size=size;
+            m.m1type=m1type;
+            m.alpha=alpha;
+            if (alpha>=0) cv::getOptimalNewCameraMatrix(CameraMatrix,Distorsion,CamSize,alpha,size).convertTo(m.cameraMatrix,CV_32FC1);
+            else m.cameraMatrix=K;
+            cv::initUndistortRectifyMap(CameraMatrix,Distorsion,cv::Mat(),m.cameraMatrix,size,m1type,m.map1,m.map2);
+            cache->maps.push_back(m);
+            map1=m.map1;
+            map2=m.map2;
+            if (usedCameraMatrix!=NULL) *usedCameraMatrix=m.cameraMatrix.clone();
+        }
+    }
+}
+
+/**
+ */
+void CameraParameters::undistort(const cv::Mat &in,cv::Mat &out,const cv::Mat &newCameraMatrix,cv::Size size)const throw(cv::Exception)
+{
+    if (in.size()!=CamSize) throw cv::Exception(9007,"the size of the image is not CamSize","CameraParameters::undistort",__FILE__,__LINE__);
+    cv::Mat map1,map2;
+    getUndistortionMaps(map1,map2,newCameraMatrix,size);
+    cv::remap(in,out,map1,map2,cv::INTER_LINEAR);
 }
 
 /****
@@ -89,6 +89,46 @@ public:
      */
     void resize(cv::Size size)throw(cv::Exception);
 
+    /**Indicates if the parameters are equal to these passed
+     */
+    bool equals(const cv::Mat &cameraMatrix,const cv::Mat &distorsionCoeff,cv::Size size)const;
+
+    /**Removes the distortion of points of the image, e.g., the corners of the markers detected in the image as captured.
+     * A table with the undistorted position of the points of a regular grid of the image (of size CamSize) is built in the first call,
+     * and the points are interpolated in it, which is much faster than cv::undistortPoints. The table is kept while the parameters
+     * do not change, and it is shared by the copies of this object. The points out of the image are undistorted with cv::undistortPoints.
+     * @param points input points, in pixels
+     * @param undistorted output points, in pixels of the undistorted image (as obtained by undistort). It can be the same vector as points
+     */
+    void undistortPoints(const vector<cv::Point2f> &points,vector<cv::Point2f> &undistorted)const throw(cv::Exception);
+    /**Returns the maps of cv::remap that remove the distortion of the images of size CamSize, as cv::initUndistortRectifyMap.
+     * The maps are computed in the first call for each combination of output camera matrix, size and type, and kept while the
+     * parameters do not change, so that undistorting an image only requires a cv::remap. The cache is shared by the copies of this
+     * object (e.g., these of the detectors that employ the same camera), and it is protected by a mutex of the library, so that
+     * it can be accessed from several threads at once (with or without OpenMP). Note that resize changes the parameters, so that
+     * the maps are computed again.
+     * @param map1,map2 output maps
+     * @param newCameraMatrix camera matrix of the undistorted image. If empty, CameraMatrix
+     * @param size size of the undistorted image. If empty, CamSize
+     * @param m1type type of map1: CV_16SC2 (fixed point, the fastest remap) or CV_32FC1
+     */
+    void getUndistortionMaps(cv::Mat &map1,cv::Mat &map2,const cv::Mat &newCameraMatrix=cv::Mat(),cv::Size size=cv::Size(),int m1type=CV_16SC2)const throw(cv::Exception);
+    /**As getUndistortionMaps, but the camera matrix of the undistorted image is the one given by cv::getOptimalNewCameraMatrix
+     * @param map1,map2 output maps
+     * @param alpha free scaling parameter, between 0 (all the pixels of the undistorted image are valid) and 1 (all the pixels of the input are kept)
+     * @param newCameraMatrix output camera matrix of the undistorted image
+     * @param size size of the undistorted image. If empty, CamSize
+     * @param m1type type of map1: CV_16SC2 (fixed point, the fastest remap) or CV_32FC1
+     */
+    void getOptimalUndistortionMaps(cv::Mat &map1,cv::Mat &map2,double alpha,cv::Mat &newCameraMatrix,cv::Size size=cv::Size(),int m1type=CV_16SC2)const throw(cv::Exception);
+    /**Removes the distortion of an image of size CamSize, as cv::undistort, with the cached maps of getUndistortionMaps
+     * @param in input image
+     * @param out output undistorted image
+     * @param newCameraMatrix camera matrix of the undistorted image. If empty, CameraMatrix
+     * @param size size of the undistorted image. If empty, CamSize
+     */
+    void undistort(const cv::Mat &in,cv::Mat &out,const cv::Mat &newCameraMatrix=cv::Mat(),cv::Size size=cv::Size())const throw(cv::Exception);
+
     /**Returns the location of the camera in the reference system given by the rotation and translation vectors passed
      * NOT TESTED
     */
@@ -120,6 +160,28 @@ public:
     
 
 private:
+    //maps of cv::remap for an output size, type and camera matrix (given or obtained from alpha, which is -1 otherwise)
+    struct RemapMaps {
+        cv::Size size;
+        int m1type;
+        double alpha;
+        cv::Mat cameraMatrix;
+        cv::Mat map1,map2;
+    };
+    //undistortion data derived from the parameters. It is shared by the copies of the object, and rebuilt when the parameters change.
+    //It is accessed with the lock of the mutex undistortionCacheMutex (see cameraparameters.cpp)
+    struct UndistortionCache {
+        cv::Mat cameraMatrix,distorsion;//parameters from which it has been built
+        cv::Size size;
+        int tableStep;//distance in pixels between the points of the table
+        cv::Mat table;//undistorted position of the points (x*tableStep,y*tableStep) of the image (CV_32FC2)
+        vector<RemapMaps> maps;
+    };
+    mutable cv::Ptr<UndistortionCache> _undistCache;
+    //returns the cache, which is created again if the parameters have changed
+    cv::Ptr<UndistortionCache> getUndistortionCache()const throw(cv::Exception);
+    //returns the maps of the camera matrix passed (or CameraMatrix if empty) if alpha<0, or of the optimal camera matrix for alpha otherwise
+    void getUndistortionMaps(cv::Mat &map1,cv::Mat &map2,const cv::Mat &newCameraMatrix,double alpha,cv::Size size,int m1type,cv::Mat *usedCameraMatrix=NULL)const throw(cv::Exception);
     //GL routines
 
     static void argConvGLcpara2( double cparam[3][4], int width, int height, double gnear, double gfar, double m[16], bool invert )throw(cv::Exception);
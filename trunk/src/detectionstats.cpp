@@ -0,0 +1,156 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#include "detectionstats.h"
+#include <algorithm>
+#include <cstring>
+using namespace cv;
+namespace aruco
+{
+/**
+ *
+ */
+DetectionStats::DetectionStats()
+{
+    _enabled=false;
+    _historySize=0;
+    reset();
+}
+/**
+ *
+ */
+void DetectionStats::setHistorySize(int size)
+{
+    _historySize=size<0?0:size;
+    _history.assign(_historySize*NSTAGES,0);
+    _historyPos=_historyCount=0;
+}
+/**
+ *
+ */
+void DetectionStats::reset()
+{
+    _nFrames=0;
+    memset(_lastTicks,0,sizeof(_lastTicks));
+    memset(_lastCounts,0,sizeof(_lastCounts));
+    for (int i=0;i<NSTAGES;i++) _totalTicks[i]=0;
+    for (int i=0;i<NCOUNTERS;i++) _totalCounts[i]=0;
+    setHistorySize(_historySize);
+}
+/**
+ *
+ */
+void DetectionStats::beginFrame()
+{
+    if (!_enabled) return;
+    memset(_lastTicks,0,sizeof(_lastTicks));
+    memset(_lastCounts,0,sizeof(_lastCounts));
+}
+/**
+ *
+ */
+void DetectionStats::clearLastCounts()
+{
+    if (!_enabled) return;
+    memset(_lastCounts,0,sizeof(_lastCounts));
+}
+/**
+ *
+ */
+void DetectionStats::endFrame()
+{
+    if (!_enabled) return;
+    _nFrames++;
+    for (int i=0;i<NSTAGES;i++) _totalTicks[i]+=_lastTicks[i];
+    for (int i=0;i<NCOUNTERS;i++) _totalCounts[i]+=_lastCounts[i];
+    if (_historySize>0) {
+        for (int i=0;i<NSTAGES;i++) _history[_historyPos*NSTAGES+i]=getLastTime(Stage(i));
+        _historyPos=(_historyPos+1)%_historySize;
+        if (_historyCount<_historySize) _historyCount++;
+    }
+}
+/**
+ *
+ */
+double DetectionStats::getLastTime(Stage s)const
+{
+    return 1000.*double(_lastTicks[s])/getTickFrequency();
+}
+/**
+ *
+ */
+double DetectionStats::getMeanTime(Stage s)const
+{
+    if (_nFrames==0) return 0;
+    return 1000.*_totalTicks[s]/getTickFrequency()/_nFrames;
+}
+/**
+ *
+ */
+double DetectionStats::getPercentile(Stage s,double p)const
+{
+    if (_historyCount==0) return -1;
+    vector<double> values(_historyCount);
+    for (int i=0;i<_historyCount;i++) values[i]=_history[i*NSTAGES+s];
+    //nearest rank
+    p=std::max(0.,std::min(100.,p));
+    int k=cvCeil(p/100.*_historyCount)-1;
+    if (k<0) k=0;
+    std::nth_element(values.begin(),values.begin()+k,values.end());
+    return values[k];
+}
+/**
+ *
+ */
+const char *DetectionStats::getStageName(Stage s)
+{
+    static const char *names[NSTAGES]={"grey","pyrdown","threshold","erosion","contours","quads","warp","decode","corner_refinement","dedup","undistortion","extrinsics","total"};
+    return names[s];
+}
+/**
+ *
+ */
+const char *DetectionStats::getCounterName(Counter c)
+{
+    static const char *names[NCOUNTERS]={"contours","rejected_size","rejected_shape","quads","rejected_too_near","rejected_warp","rejected_id","rejected_duplicated","detections","rescans"};
+    return names[c];
+}
+/**
+ *
+ */
+ostream & operator<<(ostream &str,const DetectionStats &S)
+{
+    str<<"frames="<<S.getNumFrames()<<endl;
+    for (int i=0;i<DetectionStats::NSTAGES;i++)
+        str<<DetectionStats::getStageName(DetectionStats::Stage(i))<<"="<<S.getMeanTime(DetectionStats::Stage(i))<<"ms ";
+    str<<endl;
+    for (int i=0;i<DetectionStats::NCOUNTERS;i++)
+        str<<DetectionStats::getCounterName(DetectionStats::Counter(i))<<"="<<S.getTotalCount(DetectionStats::Counter(i))<<" ";
+    str<<endl;
+    return str;
+}
+};
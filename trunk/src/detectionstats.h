@@ -0,0 +1,158 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#ifndef _Aruco_DetectionStats_H
+#define _Aruco_DetectionStats_H
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include "exports.h"
+using namespace std;
+namespace aruco
+{
+/**\brief Timings and counters of the stages of the marker detection (see MarkerDetector::setStatsEnabled)
+ *
+ * The detector accumulates the time spent in each stage and the number of elements processed in each call
+ * to detect. The values of the last call are available until the next one, and the totals since the
+ * last reset are kept too. If a history size is set, the stage times of the last frames are also kept, so that
+ * percentiles over a rolling window can be obtained.
+ *
+ * The stages run in parallel (warp, decode and the LINES refinement) are measured per candidate, so their
+ * time is the sum over all the threads and not the elapsed time.
+ */
+class ARUCO_EXPORTS DetectionStats
+{
+public:
+    /**Stages of the detection. TOTAL is the whole call to detect. With MarkerDetector::BORDER_FOLLOWING, the analysis of the
+     * contours is done while they are extracted, so it is included in CONTOURS. UNDISTORTION is the undistortion of the corners
+     * (see MarkerDetector::setCornerUndistortion). The time of the stages repeated in a frame (when a track is lost in tracking
+     * mode and the whole image is analyzed again) is accumulated
+     */
+    enum Stage {GREY=0,PYRDOWN,THRESHOLD,EROSION,CONTOURS,QUADS,WARP,DECODE,CORNER_REFINEMENT,DEDUP,UNDISTORTION,EXTRINSICS,TOTAL,NSTAGES};
+    /**Counters of the detection.
+     * CONTOURS: contours extracted. REJECTED_SIZE: contours out of the size limits. REJECTED_SHAPE: contours that are not convex quads
+     * with large enough sides. QUADS: rectangles found. REJECTED_TOO_NEAR: rectangles removed for being too near to another one.
+     * REJECTED_WARP: candidates that could not be warped. REJECTED_ID: candidates without valid id. REJECTED_DUPLICATED: markers detected twice.
+     * DETECTIONS: markers detected. RESCANS: times that the whole image has been analyzed again because a track was lost. In that case,
+     * the rest of counters are these of the second analysis, so that the candidates are not counted twice
+     */
+    enum Counter {N_CONTOURS=0,REJECTED_SIZE,REJECTED_SHAPE,N_QUADS,REJECTED_TOO_NEAR,REJECTED_WARP,REJECTED_ID,REJECTED_DUPLICATED,N_DETECTIONS,N_RESCANS,NCOUNTERS};
+
+    DetectionStats();
+
+    /**Enables/disables the measurement. When disabled, the detector does not even read the clock
+     */
+    void setEnabled(bool enable){_enabled=enable;}
+    /**
+     */
+    bool isEnabled()const{return _enabled;}
+    /**Sets the number of frames whose stage times are kept to compute percentiles (0 disables the history).
+     * The history is cleared
+     */
+    void setHistorySize(int size);
+    /**
+     */
+    int getHistorySize()const{return _historySize;}
+    /**Clears all the values
+     */
+    void reset();
+
+    ///-------------------------------------------------
+    /// Methods employed by the detector
+    ///-------------------------------------------------
+    /**Starts a new frame: the values of the last one are cleared
+     */
+    void beginFrame();
+    /**Ends the current frame: its values are added to the totals and to the history
+     */
+    void endFrame();
+    /**Returns the current tick count if enabled (0 otherwise). Use it with toc to measure a stage
+     */
+    int64 tic()const{return _enabled?cv::getTickCount():0;}
+    /**Adds to the stage s the time since the tick t, and sets t to the current tick count
+     */
+    void toc(Stage s,int64 &t){
+        if (!_enabled) return;
+        int64 now=cv::getTickCount();
+        _lastTicks[s]+=now-t;
+        t=now;
+    }
+    /**Adds ticks to the stage s (for the stages measured by parts)
+     */
+    void addTicks(Stage s,int64 ticks){if (_enabled) _lastTicks[s]+=ticks;}
+    /**Increases the counter c
+     */
+    void count(Counter c,int n=1){if (_enabled) _lastCounts[c]+=n;}
+    /**Clears the counters of the current frame, but not its times (for the stages that are repeated)
+     */
+    void clearLastCounts();
+
+    ///-------------------------------------------------
+    /// Results
+    ///-------------------------------------------------
+    /**Number of frames measured since the last reset
+     */
+    int getNumFrames()const{return _nFrames;}
+    /**Time in milliseconds of the stage in the last frame
+     */
+    double getLastTime(Stage s)const;
+    /**Mean time in milliseconds of the stage since the last reset
+     */
+    double getMeanTime(Stage s)const;
+    /**Percentile p (in [0,100]) of the time in milliseconds of the stage in the frames of the history.
+     * Returns -1 if the history is empty
+     */
+    double getPercentile(Stage s,double p)const;
+    /**Value of the counter in the last frame
+     */
+    int getLastCount(Counter c)const{return _lastCounts[c];}
+    /**Value of the counter since the last reset
+     */
+    double getTotalCount(Counter c)const{return _totalCounts[c];}
+    /**
+     */
+    static const char *getStageName(Stage s);
+    /**
+     */
+    static const char *getCounterName(Counter c);
+
+    /**Prints the mean times and the total counters
+     */
+    friend ostream & operator<<(ostream &str,const DetectionStats &S);
+
+private:
+    bool _enabled;
+    int _nFrames;
+    int64 _lastTicks[NSTAGES];
+    double _totalTicks[NSTAGES];
+    int _lastCounts[NCOUNTERS];
+    double _totalCounts[NCOUNTERS];
+    //stage times (ms) of the last frames: a ring of _historySize frames of NSTAGES values
+    vector<double> _history;
+    int _historySize,_historyPos,_historyCount;
+};
+};
+#endif
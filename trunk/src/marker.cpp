@@ -26,6 +26,7 @@ authors and should not be interpreted as representing official policies, either
 or implied, of Rafael Muñoz Salinas.
 ********************************/
 #include "marker.h"
+#include "squareposesolver.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <cstdio>
@@ -39,6 +40,7 @@ Marker::Marker()
 {
     id=-1;
     ssize=-1;
+    nCorrectedBits=0;
     Rvec.create(3,1,CV_32FC1);
     Tvec.create(3,1,CV_32FC1);
     for (int i=0;i<3;i++)
@@ -53,6 +55,7 @@ Marker::Marker(const Marker &M):std::vector<cv::Point2f>(M)
     M.Tvec.copyTo(Tvec);
     id=M.id;
     ssize=M.ssize;
+    nCorrectedBits=M.nCorrectedBits;
 }
 
 /**
@@ -62,6 +65,7 @@ Marker::Marker(const  std::vector<cv::Point2f> &corners,int _id):std::vector<cv:
 {
     id=_id;
     ssize=-1;
+    nCorrectedBits=0;
     Rvec.create(3,1,CV_32FC1);
     Tvec.create(3,1,CV_32FC1);
     for (int i=0;i<3;i++)
@@ -263,6 +267,25 @@ void Marker::calculateExtrinsics(float markerSizeMeters,cv::Mat  camMatrix,cv::M
     if (markerSizeMeters<=0)throw cv::Exception(9004,"markerSize<=0: invalid markerSize","calculateExtrinsics",__FILE__,__LINE__);
     if ( camMatrix.rows==0 || camMatrix.cols==0) throw cv::Exception(9004,"CameraMatrix is empty","calculateExtrinsics",__FILE__,__LINE__);
  
+    //without distortion, the closed form solution is used and refined, as in the batch version. The iterative one is only kept as fallback
+    if ((distCoeff.total()==0 || countNonZero(distCoeff)==0) && camMatrix.rows==3 && camMatrix.cols==3) {
+        Mat K;
+        camMatrix.convertTo(K,CV_64F);
+        double fx=K.at<double>(0,0),fy=K.at<double>(1,1),cx=K.at<double>(0,2),cy=K.at<double>(1,2);
+        double u[4],v[4];
+        for (int c=0;c<4;c++) {
+            u[c]=((*this)[c].x-cx)/fx;
+            v[c]=((*this)[c].y-cy)/fy;
+        }
+        SquarePoseSolver::Pose best,alternative;
+        if (SquarePoseSolver::solveNormalized(u,v,markerSizeMeters,fx,fy,best,alternative)) {
+            SquarePoseSolver::refine(u,v,markerSizeMeters,fx,fy,best);
+            SquarePoseSolver::toRvecTvec(best,Rvec,Tvec,setYPerperdicular);
+            ssize=markerSizeMeters;
+            return;
+        }
+    }
+
      double halfSize=markerSizeMeters/2.;
     cv::Mat ObjPoints(4,3,CV_32FC1);
     ObjPoints.at<float>(1,0)=-halfSize;
@@ -294,8 +317,105 @@ void Marker::calculateExtrinsics(float markerSizeMeters,cv::Mat  camMatrix,cv::M
     //rotate the X axis so that Y is perpendicular to the marker plane
    if (setYPerperdicular) rotateXAxis(Rvec);
     ssize=markerSizeMeters; 
-    cout<<(*this)<<endl;
-    
+}
+
+/**
+ */
+void Marker::calculateExtrinsics(std::vector<Marker> &markers,float markerSizeMeters,cv::Mat camMatrix,cv::Mat distCoeff,bool setYPerperdicular,int nThreads,
+                                 std::map<int,SquarePoseSolver::Pose> *poses,int nIterations)throw(cv::Exception)
+{
+    if (markerSizeMeters<=0)throw cv::Exception(9004,"markerSize<=0: invalid markerSize","calculateExtrinsics",__FILE__,__LINE__);
+    if ( camMatrix.rows!=3 || camMatrix.cols!=3) throw cv::Exception(9004,"CameraMatrix must be 3x3","calculateExtrinsics",__FILE__,__LINE__);
+    for (size_t i=0;i<markers.size();i++)
+        if (!markers[i].isValid()) throw cv::Exception(9004,"!isValid(): invalid marker. It is not possible to calculate extrinsics","calculateExtrinsics",__FILE__,__LINE__);
+    int n=markers.size();
+    if (n==0) {
+        if (poses!=NULL) poses->clear();
+        return;
+    }
+    Mat K;
+    camMatrix.convertTo(K,CV_64F);
+    double fx=K.at<double>(0,0),fy=K.at<double>(1,1),cx=K.at<double>(0,2),cy=K.at<double>(1,2);
+
+    //normalized coordinates of all the corners, as structure of arrays: u[c*n+i] is the corner c of the marker i
+    vector<double> u(4*n),v(4*n);
+    if (distCoeff.total()!=0 && countNonZero(distCoeff)!=0) {
+        Mat pixels(4*n,1,CV_32FC2),undistorted;
+        for (int i=0;i<n;i++)
+            for (int c=0;c<4;c++)
+                pixels.at<Point2f>(i*4+c,0)=markers[i][c];
+        undistortPoints(pixels,undistorted,camMatrix,distCoeff);
+        for (int i=0;i<n;i++)
+            for (int c=0;c<4;c++) {
+                const Point2f &p=undistorted.at<Point2f>(i*4+c,0);
+                u[c*n+i]=p.x;
+                v[c*n+i]=p.y;
+            }
+    }
+    else {
+        double ifx=1./fx,ify=1./fy;
+        for (int c=0;c<4;c++) {
+            double *uc=&u[c*n],*vc=&v[c*n];
+            for (int i=0;i<n;i++) {
+                uc[i]=(markers[i][c].x-cx)*ifx;
+                vc[i]=(markers[i][c].y-cy)*ify;
+            }
+        }
+    }
+
+    //previous pose of each marker, if any
+    vector<const SquarePoseSolver::Pose *> previous(n,(const SquarePoseSolver::Pose *)NULL);
+    vector<SquarePoseSolver::Pose> solved(n);
+    vector<char> isSolved(n,0);
+    if (poses!=NULL)
+        for (int i=0;i<n;i++) {
+            std::map<int,SquarePoseSolver::Pose>::const_iterator it=poses->find(markers[i].id);
+            if (it!=poses->end()) previous[i]=&it->second;
+        }
+
+    //the solution of each marker is cheap, so that only large sets are worth distributing among threads
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(nThreads) schedule(static) if(nThreads>1 && n>=32)
+#endif
+    for (int i=0;i<n;i++) {
+        double ui[4]={u[i],u[n+i],u[2*n+i],u[3*n+i]};
+        double vi[4]={v[i],v[n+i],v[2*n+i],v[3*n+i]};
+        SquarePoseSolver::Pose &best=solved[i],alternative;
+        if (previous[i]!=NULL)
+            isSolved[i]=SquarePoseSolver::solveNormalized(ui,vi,markerSizeMeters,fx,fy,*previous[i],best,nIterations);
+        else {
+            //the closed form solution is refined so as to minimize the reprojection error, as solvePnP does
+            isSolved[i]=SquarePoseSolver::solveNormalized(ui,vi,markerSizeMeters,fx,fy,best,alternative);
+            if (isSolved[i]) SquarePoseSolver::refine(ui,vi,markerSizeMeters,fx,fy,best,nIterations);
+        }
+        if (isSolved[i])
+            SquarePoseSolver::toRvecTvec(best,markers[i].Rvec,markers[i].Tvec,setYPerperdicular);
+        else {
+            //degenerated corners, solvePnP is used on the normalized points
+            cv::Mat ObjPoints(4,3,CV_32FC1),ImagePoints(4,2,CV_32FC1),raux,taux;
+            cv::Mat I=cv::Mat::eye(3,3,CV_32F);
+            double h=markerSizeMeters/2.;
+            const double X[4]={-h,-h,h,h},Y[4]={-h,h,h,-h};
+            for (int c=0;c<4;c++) {
+                ObjPoints.at<float>(c,0)=X[c];
+                ObjPoints.at<float>(c,1)=Y[c];
+                ObjPoints.at<float>(c,2)=0;
+                ImagePoints.at<float>(c,0)=ui[c];
+                ImagePoints.at<float>(c,1)=vi[c];
+            }
+            cv::solvePnP(ObjPoints,ImagePoints,I,Mat(),raux,taux);
+            raux.convertTo(markers[i].Rvec,CV_32F);
+            taux.convertTo(markers[i].Tvec,CV_32F);
+            if (setYPerperdicular) markers[i].rotateXAxis(markers[i].Rvec);
+        }
+        markers[i].ssize=markerSizeMeters;
+    }
+    //keep the poses of this frame for the next one
+    if (poses!=NULL) {
+        poses->clear();
+        for (int i=0;i<n;i++)
+            if (isSolved[i]) (*poses)[markers[i].id]=solved[i];
+    }
 }
 
 
@@ -28,10 +28,12 @@ or implied, of Rafael Muñoz Salinas.
 #ifndef _Aruco_Marker_H
 #define _Aruco_Marker_H
 #include <vector>
+#include <map>
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include "exports.h"
 #include "cameraparameters.h"
+#include "squareposesolver.h"
 using namespace std;
 namespace aruco {
 /**\brief This class represents a marker. It is a vector of the fours corners ot the marker
@@ -47,6 +49,8 @@ public:
     float ssize;
     //matrices of rotation and translation respect to the camera
     cv::Mat Rvec,Tvec;
+    //number of bits of the code that were corrected to identify the marker
+    int nCorrectedBits;
 
     /**
      */
@@ -79,8 +83,28 @@ public:
      * @param CameraMatrix matrix with camera parameters (fx,fy,cx,cy)
      * @param Distorsion matrix with distorsion parameters (k1,k2,p1,p2)
      * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
+     *
+     * If the distortion is empty or zero (e.g., the corners have already been undistorted), the closed form solution of
+     * SquarePoseSolver is used, refined to minimize the reprojection error. Otherwise, the pose is obtained with cv::solvePnP
      */
     void calculateExtrinsics(float markerSize,cv::Mat  CameraMatrix,cv::Mat Distorsion=cv::Mat(),bool setYPerperdicular=true)throw(cv::Exception);
+    /**Calculates the extrinsics of a set of markers at once, filling Rvec and Tvec of each one as the method above.
+     * The corners of all the markers are undistorted in a single pass and the poses are obtained with SquarePoseSolver,
+     * whose closed form solution is refined to minimize the reprojection error (see SquarePoseSolver::refine).
+     * With a non zero distortion, the result may differ slightly from the one of the method above, which minimizes the
+     * error of the distorted projection with cv::solvePnP
+     * @param markers markers to process
+     * @param markerSize size of the marker side expressed in meters
+     * @param CameraMatrix matrix with camera parameters (fx,fy,cx,cy)
+     * @param Distorsion matrix with distorsion parameters (k1,k2,p1,p2)
+     * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
+     * @param nThreads number of threads among which large sets of markers are distributed
+     * @param poses if not NULL, poses of the markers in the previous frame indexed by id. The markers found in it are solved
+     *  from their previous pose (see SquarePoseSolver::solveNormalized). On output, it contains the poses of the markers processed
+     * @param nIterations maximum number of iterations of the refinement of the poses
+     */
+    static void calculateExtrinsics(std::vector<Marker> &markers,float markerSize,cv::Mat CameraMatrix,cv::Mat Distorsion=cv::Mat(),bool setYPerperdicular=true,int nThreads=1,
+                                    std::map<int,SquarePoseSolver::Pose> *poses=NULL,int nIterations=3)throw(cv::Exception);
     
     /**Given the extrinsic camera parameters returns the GL_MODELVIEW matrix for opengl.
      * Setting this matrix, the reference coordinate system will be set in this marker
@@ -32,6 +32,15 @@ or implied, of Rafael Muñoz Salinas.
 #include <fstream>
 #include "arucofidmarkers.h"
 #include <valarray>
+#include <cstring>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#ifdef __AVX2__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 using namespace std;
 using namespace cv;
 
@@ -53,7 +62,19 @@ MarkerDetector::MarkerDetector()
     _markerWarpSize=56;
     _speed=0;
     markerIdDetector_ptrfunc=aruco::FiducidalMarkers::detect;
+    markerCellsIdDetector_ptrfunc=NULL;
+    _nCells=7;
+    _nSamplesPerCell=3;
+    _maxCorrectedBits=0;
     pyrdown_level=0; // no image reduction
+    _nThreads=1;
+    _tracking=false;
+    _fullScanPeriod=10;
+    _roiScale=2;
+    _poseTracking=false;
+    _poseIterations=3;
+    _cornerUndistortion=false;
+    _contourMethod=OPENCV_CONTOURS;
     _minSize=0.04;
     _maxSize=0.5;
 }
@@ -106,23 +127,59 @@ void MarkerDetector::setDesiredSpeed ( int val )
  ************************************/
 void MarkerDetector::detect ( const  cv::Mat &input,std::vector<Marker> &detectedMarkers, CameraParameters camParams ,float markerSizeMeters ,bool setYPerperdicular) throw ( cv::Exception )
 {
-    detect ( input, detectedMarkers,camParams.CameraMatrix ,camParams.Distorsion,  markerSizeMeters ,setYPerperdicular);
+    detect ( input, detectedMarkers,_ws,camParams,  markerSizeMeters ,setYPerperdicular);
 }
 
-
 /************************************
  *
- * Main detection function. Performs all steps
+ *
  *
  *
  ************************************/
 void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMarkers,Mat camMatrix ,Mat distCoeff ,float markerSizeMeters ,bool setYPerperdicular) throw ( cv::Exception )
 {
+    detect ( input, detectedMarkers,_ws,camMatrix ,distCoeff,  markerSizeMeters ,setYPerperdicular);
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::detect ( const  cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws, CameraParameters camParams ,float markerSizeMeters ,bool setYPerperdicular) const throw ( cv::Exception )
+{
+    //the undistortion table of the parameters passed is shared, so that it is only built once
+    if ( _cornerUndistortion && camParams.isValid() && camParams.CamSize==input.size() ) ws.undistortion=camParams;
+    detect ( input, detectedMarkers,ws,camParams.CameraMatrix ,camParams.Distorsion,  markerSizeMeters ,setYPerperdicular);
+}
+
 
+/************************************
+ *
+ * Main detection function. Performs all steps
+ *
+ *
+ ************************************/
+void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMarkers,Workspace &ws,Mat camMatrix ,Mat distCoeff ,float markerSizeMeters ,bool setYPerperdicular) const throw ( cv::Exception )
+{
+    DetectionStats &stats=ws.stats;
+    stats.beginFrame();
+    int64 startTick=stats.tic(),tick=startTick;
 
     //it must be a 3 channel image
-    if ( input.type() ==CV_8UC3 )   cv::cvtColor ( input,grey,CV_BGR2GRAY );
-    else     grey=input;
+    if ( input.type() ==CV_8UC3 )
+    {
+        if ( ws.greyIsInput ) ws.grey.release();//do not write on the image passed in a previous call
+        cv::cvtColor ( input,ws.grey,CV_BGR2GRAY );
+        ws.greyIsInput=false;
+    }
+    else
+    {
+        ws.grey=input;
+        ws.greyIsInput=true;
+    }
+    stats.toc ( DetectionStats::GREY,tick );
 
 
 //     cv::cvtColor(grey,_ssImC ,CV_GRAY2BGR); //DELETE
@@ -131,41 +188,307 @@ void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMark
     detectedMarkers.clear();
 
 
-    cv::Mat imgToBeThresHolded=grey;
+    cv::Mat imgToBeThresHolded=ws.grey;
     double ThresParam1=_thresParam1,ThresParam2=_thresParam2;
     //Must the image be downsampled before continue processing?
     if ( pyrdown_level!=0 )
     {
-        reduced=grey;
+        //each level is kept in its own buffer so that it is not allocated again in the next call
+        if ( ws.pyramid.size() < ( size_t ) pyrdown_level ) ws.pyramid.resize ( pyrdown_level );
+        cv::Mat *reduced=&ws.grey;
         for ( int i=0;i<pyrdown_level;i++ )
         {
-            cv::Mat tmp;
-            cv::pyrDown ( reduced,tmp );
-            reduced=tmp;
+            cv::pyrDown ( *reduced,ws.pyramid[i] );
+            reduced=&ws.pyramid[i];
         }
         int red_den=pow ( 2.0f,pyrdown_level );
-        imgToBeThresHolded=reduced;
+        imgToBeThresHolded=*reduced;
         ThresParam1/=float ( red_den );
         ThresParam2/=float ( red_den );
     }
+    stats.toc ( DetectionStats::PYRDOWN,tick );
+
+    ///Find the candidates and identify them. In tracking mode, only the regions around the markers of
+    ///the previous frame are analyzed, unless it is time for a full scan of the image
+    bool fullScan=!_tracking || ws.trackedIds.empty() || ws.nFramesSinceFullScan+1>=_fullScanPeriod;
+    if ( !fullScan ) getTrackingRois ( ws,imgToBeThresHolded.size(),1./pow ( 2.0f,pyrdown_level ) );
+    findCandidates ( imgToBeThresHolded,ws,ThresParam1,ThresParam2,fullScan );
+    identifyCandidates ( ws,detectedMarkers );
+    //if any of the tracked markers has been lost, the whole image is analyzed again. The counters of the first
+    //analysis are discarded, so that its candidates are not counted twice
+    if ( !fullScan && isTrackLost ( ws,detectedMarkers ) )
+    {
+        fullScan=true;
+        stats.clearLastCounts();
+        stats.count ( DetectionStats::N_RESCANS );
+        findCandidates ( imgToBeThresHolded,ws,ThresParam1,ThresParam2,fullScan );
+        identifyCandidates ( ws,detectedMarkers );
+    }
+    ws.nFramesSinceFullScan=fullScan?0:ws.nFramesSinceFullScan+1;
+
+    tick=stats.tic();
+    ///refine the corner location if desired
+    if ( detectedMarkers.size() >0 && _cornerMethod!=NONE && _cornerMethod!=LINES )
+    {
+        vector<Point2f> &Corners=ws.corners;
+        Corners.clear();
+        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
+            for ( int c=0;c<4;c++ )
+                Corners.push_back ( detectedMarkers[i][c] );
+
+        if ( _cornerMethod==HARRIS )
+            findBestCornerInRegion_harris ( ws.grey, Corners,7,ws.harris );
+        else if ( _cornerMethod==SUBPIX )
+            cornerSubPix ( ws.grey, Corners,cvSize ( 5,5 ), cvSize ( -1,-1 )   ,cvTermCriteria ( CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,3,0.05 ) );
+
+        //copy back
+        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
+            for ( int c=0;c<4;c++ )     detectedMarkers[i][c]=Corners[i*4+c];
+    }
+    stats.toc ( DetectionStats::CORNER_REFINEMENT,tick );
+    //sort by id
+    std::sort ( detectedMarkers.begin(),detectedMarkers.end() );
+    //there might be still the case that a marker is detected twice because of the double border indicated earlier,
+    //detect and remove these cases
+    vector<bool> &toRemove=ws.toRemove;
+    toRemove.assign ( detectedMarkers.size(),false );
+    for ( int i=0;i<int ( detectedMarkers.size() )-1;i++ )
+    {
+        if ( detectedMarkers[i].id==detectedMarkers[i+1].id && !toRemove[i+1] )
+        {
+            //deletes the one with smaller perimeter
+            if ( perimeter ( detectedMarkers[i] ) >perimeter ( detectedMarkers[i+1] ) ) toRemove[i+1]=true;
+            else toRemove[i]=true;
+            stats.count ( DetectionStats::REJECTED_DUPLICATED );
+        }
+    }
+    //remove the markers marker
+    removeElements ( detectedMarkers, toRemove );
+    //keep the markers to be tracked in the next frame
+    if ( _tracking )
+    {
+        ws.tracked.resize ( detectedMarkers.size() );
+        ws.trackedIds.resize ( detectedMarkers.size() );
+        for ( size_t i=0;i<detectedMarkers.size();i++ )
+        {
+            ws.tracked[i]=detectedMarkers[i];
+            ws.trackedIds[i]=detectedMarkers[i].id;
+        }
+        ws.trackedArePredicted=false;
+    }
+    stats.toc ( DetectionStats::DEDUP,tick );
+
+    ///remove the distortion of the corners if desired, so that they are these of the undistorted image
+    if ( _cornerUndistortion && detectedMarkers.size() >0 && camMatrix.rows!=0 && distCoeff.total() !=0 && countNonZero ( distCoeff ) !=0 )
+    {
+        vector<Point2f> &Corners=ws.corners;
+        Corners.clear();
+        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
+            for ( int c=0;c<4;c++ )
+                Corners.push_back ( detectedMarkers[i][c] );
+        //the table of CameraParameters is only available for the models it holds (4 or 5 coefficients, see setParams)
+        if ( distCoeff.total() >=4 && distCoeff.total() <7 )
+        {
+            if ( !ws.undistortion.equals ( camMatrix,distCoeff,input.size() ) ) ws.undistortion.setParams ( camMatrix,distCoeff,input.size() );
+            ws.undistortion.undistortPoints ( Corners,Corners );
+        }
+        else
+        {
+            Mat pts ( Corners.size(),1,CV_32FC2 ),und,K;
+            for ( size_t i=0;i<Corners.size();i++ ) pts.at<Point2f> ( i,0 ) =Corners[i];
+            cv::undistortPoints ( pts,und,camMatrix,distCoeff );
+            camMatrix.convertTo ( K,CV_64F );
+            for ( size_t i=0;i<Corners.size();i++ )
+            {
+                const Point2f &p=und.at<Point2f> ( i,0 );
+                Corners[i]=Point2f ( p.x*K.at<double> ( 0,0 ) +K.at<double> ( 0,2 ),p.y*K.at<double> ( 1,1 ) +K.at<double> ( 1,2 ) );
+            }
+        }
+        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
+            for ( int c=0;c<4;c++ )     detectedMarkers[i][c]=Corners[i*4+c];
+        //the corners are now free of distortion
+        distCoeff=Mat();
+    }
+    stats.toc ( DetectionStats::UNDISTORTION,tick );
+    ///detect the position of detected markers if desired
+    if ( camMatrix.rows!=0  && markerSizeMeters>0 )
+    {
+        Marker::calculateExtrinsics ( detectedMarkers,markerSizeMeters,camMatrix,distCoeff,setYPerperdicular,_nThreads,_poseTracking?&ws.poses:NULL,_poseIterations );
+    }
+    stats.toc ( DetectionStats::EXTRINSICS,tick );
+    ws.updateReallocations();
+    stats.count ( DetectionStats::N_DETECTIONS,detectedMarkers.size() );
+    stats.toc ( DetectionStats::TOTAL,startTick );
+    stats.endFrame();
+}
+
+
+/************************************
+ *
+ * Detection in a set of frames. Each thread employs its own workspace
+ *
+ *
+ ************************************/
+void MarkerDetector::detectBatch ( const vector<Mat> &frames,vector<vector<Marker> > &detectedMarkers,Mat camMatrix ,Mat distCoeff ,float markerSizeMeters ,bool setYPerperdicular ) throw ( cv::Exception )
+{
+    detectedMarkers.resize ( frames.size() );
+    if ( _batchWs.size() < ( size_t ) _nThreads ) _batchWs.resize ( _nThreads );
+    //the exceptions can not leave the parallel region. The first one is thrown afterwards, as a cv::Exception
+    bool failed=false;
+    cv::Exception error;
+    int nFrames=frames.size();
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(_nThreads) schedule(dynamic) if(_nThreads>1)
+#endif
+    for ( int i=0;i<nFrames;i++ )
+    {
+        int tid=0;
+#ifdef _OPENMP
+        tid=omp_get_thread_num();
+#endif
+        Workspace &ws=_batchWs[tid];
+        ws.resetTracking();
+        try
+        {
+            detect ( frames[i],detectedMarkers[i],ws,camMatrix,distCoeff,markerSizeMeters,setYPerperdicular );
+        }
+        catch ( cv::Exception &ex )
+        {
+#ifdef _OPENMP
+            #pragma omp critical(aruco_batch_error)
+#endif
+            {
+                if ( !failed ) error=ex;
+                failed=true;
+            }
+        }
+        catch ( std::exception &ex )
+        {
+#ifdef _OPENMP
+            #pragma omp critical(aruco_batch_error)
+#endif
+            {
+                if ( !failed ) error=cv::Exception ( 9001,ex.what(),"MarkerDetector::detectBatch",__FILE__,__LINE__ );
+                failed=true;
+            }
+        }
+        catch ( ... )
+        {
+#ifdef _OPENMP
+            #pragma omp critical(aruco_batch_error)
+#endif
+            {
+                if ( !failed ) error=cv::Exception ( 9001,"unknown exception","MarkerDetector::detectBatch",__FILE__,__LINE__ );
+                failed=true;
+            }
+        }
+    }
+    if ( failed ) throw error;
+}
 
-    ///Do threshold the image and detect contours
-    thresHold ( _thresMethod,imgToBeThresHolded,thres,ThresParam1,ThresParam2 );
-    //an erosion might be required to detect chessboard like boards
-    if ( _doErosion )
+/************************************
+ *
+ * Streaming detection. The frames are read and processed in groups
+ *
+ *
+ ************************************/
+int MarkerDetector::detectBatch ( FrameSource source,MarkersCallback callback,void *userData,Mat camMatrix ,Mat distCoeff ,float markerSizeMeters ,bool setYPerperdicular ) throw ( cv::Exception )
+{
+    //a few frames per thread, so that the threads that finish first can take more frames
+    size_t groupSize=4*_nThreads;
+    if ( _batchFrames.size() <groupSize ) _batchFrames.resize ( groupSize );
+    int nProcessed=0;
+    bool more=true;
+    while ( more )
     {
-        erode ( thres,thres2,cv::Mat() );
-        thres2.copyTo(thres); //vs thres=thres2;
+        size_t n=0;
+        while ( n<groupSize && ( more=source ( _batchFrames[n],userData ) ) ) n++;
+        if ( n==0 ) break;
+        //only the n frames read are processed
+        vector<Mat> group ( _batchFrames.begin(),_batchFrames.begin() +n );
+        detectBatch ( group,_batchMarkers,camMatrix,distCoeff,markerSizeMeters,setYPerperdicular );
+        for ( size_t i=0;i<n;i++ )
+            callback ( nProcessed+i,_batchFrames[i],_batchMarkers[i],userData );
+        nProcessed+=n;
+    }
+    return nProcessed;
+}
+
+/************************************
+ *
+ * Thresholds the image and finds the rectangles in it (either in the whole image or in the tracking rois)
+ *
+ *
+ ************************************/
+void MarkerDetector::findCandidates ( const cv::Mat &img,Workspace &ws,double param1,double param2,bool fullScan ) const
+{
+    ws.nCandidates=0;
+    int64 tick=ws.stats.tic();
+    if ( fullScan )
+    {
+        ///Do threshold the image and detect contours
+        thresHold ( _thresMethod,img,ws.thres,param1,param2,ws );
+        ws.stats.toc ( DetectionStats::THRESHOLD,tick );
+        //an erosion might be required to detect chessboard like boards
+        if ( _doErosion )
+        {
+            erode ( ws.thres,ws.thres2,cv::Mat() );
+            //exchange the buffers instead of copying the eroded image
+            cv::Mat aux=ws.thres;
+            ws.thres=ws.thres2;
+            ws.thres2=aux;
+            ws.stats.toc ( DetectionStats::EROSION,tick );
+        }
+        //find all rectangles in the thresholdes image
+        detectRectangles ( ws.thres,ws );
+        //the whole image has been written in both buffers
+        ws.thresRois.assign ( 1,cv::Rect ( 0,0,img.cols,img.rows ) );
+    }
+    else
+    {
+        //only the rois are thresholded. The rest of the image must be empty, so that only the regions written in the
+        //previous call are cleared (in both buffers, since they are exchanged), or the whole buffer if it is new
+        cv::Mat *buffers[2]={&ws.thres,&ws.thres2};
+        for ( int b=0;b<2;b++ )
+        {
+            bool isNew= ( buffers[b]->size() !=img.size() || buffers[b]->type() !=CV_8UC1 );
+            buffers[b]->create ( img.size(),CV_8UC1 );
+            if ( isNew ) buffers[b]->setTo ( cv::Scalar ( 0 ) );
+            else
+                for ( size_t r=0;r<ws.thresRois.size();r++ )
+                    ( *buffers[b] ) ( ws.thresRois[r] ).setTo ( cv::Scalar ( 0 ) );
+        }
+        ws.thresRois=ws.rois;
+        for ( size_t r=0;r<ws.rois.size();r++ )
+        {
+            cv::Mat roiThres=ws.thres ( ws.rois[r] );
+            thresHold ( _thresMethod,img ( ws.rois[r] ),roiThres,param1,param2,ws );
+            ws.stats.toc ( DetectionStats::THRESHOLD,tick );
+            if ( _doErosion )
+            {
+                cv::Mat roiEroded=ws.thres2 ( ws.rois[r] );
+                erode ( roiThres,roiEroded,cv::Mat() );
+                ws.stats.toc ( DetectionStats::EROSION,tick );
+            }
+        }
+        if ( _doErosion )
+        {
+            cv::Mat aux=ws.thres;
+            ws.thres=ws.thres2;
+            ws.thres2=aux;
+        }
+        //the rois do not overlap, so each rectangle is found only once
+        for ( size_t r=0;r<ws.rois.size();r++ )
+            detectRectangles ( ws.thres,ws,ws.rois[r] );
     }
-    //find all rectangles in the thresholdes image
-    vector<MarkerCandidate > MarkerCanditates;
-    detectRectangles ( thres,MarkerCanditates );
     //if the image has been downsampled, then calcualte the location of the corners in the original image
+    tick=ws.stats.tic();
     if ( pyrdown_level!=0 )
     {
+        vector<MarkerCandidate > &MarkerCanditates=ws.candidates;
         float red_den=pow ( 2.0f,pyrdown_level );
         float offInc= ( ( pyrdown_level/2. )-0.5 );
-        for ( unsigned int i=0;i<MarkerCanditates.size();i++ ) {
+        for ( size_t i=0;i<ws.nCandidates;i++ ) {
             for ( int c=0;c<4;c++ )
             {
                 MarkerCanditates[i][c].x=MarkerCanditates[i][c].x*red_den+offInc;
@@ -179,76 +502,285 @@ void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMark
             }
         }
     }
+    ws.stats.toc ( DetectionStats::QUADS,tick );
+}
+
+//adds to dst the ticks since tick, and sets tick to the current tick count
+static inline void lapTicks ( int64 &tick,int64 &dst )
+{
+    int64 now=getTickCount();
+    dst+=now-tick;
+    tick=now;
+}
 
+/************************************
+ *
+ * Decodes the candidates found. The valid ones are added to detectedMarkers and the rest to ws.invalidCandidates
+ *
+ *
+ ************************************/
+void MarkerDetector::identifyCandidates ( Workspace &ws,vector<Marker> &detectedMarkers ) const
+{
+    detectedMarkers.clear();
+    vector<MarkerCandidate > &MarkerCanditates=ws.candidates;
+    int nCandidates=ws.nCandidates;
     ///identify the markers
-    _candidates.clear();
-    for ( unsigned int i=0;i<MarkerCanditates.size();i++ )
+    //each candidate is analyzed independently (in parallel if requested). Then, the results are gathered
+    //in the original order so that the output is the same no matter the number of threads employed
+    ws.ids.assign ( nCandidates,-1 );
+    ws.rotations.assign ( nCandidates,0 );
+    ws.warped.assign ( nCandidates,0 );
+    ws.correctedBits.assign ( nCandidates,0 );
+    if ( ws.canonicalMarkers.size() < ( size_t ) _nThreads ) ws.canonicalMarkers.resize ( _nThreads );
+    bool useCells= ( markerCellsIdDetector_ptrfunc!=NULL && !_enableCylinderWarp );
+    bool correctErrors=canCorrectErrors ( useCells );
+    //the time of each candidate is kept apart and added afterwards, so that the threads do not write the stats
+    bool timed=ws.stats.isEnabled();
+    if ( timed )
     {
+        ws.warpTicks.assign ( nCandidates,0 );
+        ws.decodeTicks.assign ( nCandidates,0 );
+        ws.refineTicks.assign ( nCandidates,0 );
+    }
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(_nThreads) schedule(dynamic) if(_nThreads>1)
+#endif
+    for ( int i=0;i<nCandidates;i++ )
+    {
+        //each thread employs its own canonical image
+        int tid=0;
+#ifdef _OPENMP
+        tid=omp_get_thread_num();
+#endif
+        Mat &canonicalMarker=ws.canonicalMarkers[tid];
+        int64 tick=timed?getTickCount() :0;
         //Find proyective homography
-        Mat canonicalMarker;
         bool resW=false;
-        if (_enableCylinderWarp)
-            resW=warp_cylinder( grey,canonicalMarker,Size ( _markerWarpSize,_markerWarpSize ),MarkerCanditates[i] );
-        else  resW=warp ( grey,canonicalMarker,Size ( _markerWarpSize,_markerWarpSize ),MarkerCanditates[i] );
+        if ( useCells )//only the cells are sampled, the canonical image is not created
+            resW=sampleCells ( ws.grey,canonicalMarker,_nCells,_nSamplesPerCell,MarkerCanditates[i] );
+        else if (_enableCylinderWarp)
+            resW=warp_cylinder( ws.grey,canonicalMarker,Size ( _markerWarpSize,_markerWarpSize ),MarkerCanditates[i] );
+        else  resW=warp ( ws.grey,canonicalMarker,Size ( _markerWarpSize,_markerWarpSize ),MarkerCanditates[i] );
+        if ( timed ) lapTicks ( tick,ws.warpTicks[i] );
         if (resW) {
-            int nRotations;
-            int id= ( *markerIdDetector_ptrfunc ) ( canonicalMarker,nRotations );
-            if ( id!=-1 )
-            {
-		if(_cornerMethod==LINES) refineCandidateLines( MarkerCanditates[i] ); // make LINES refinement before lose contour points
-                detectedMarkers.push_back ( MarkerCanditates[i] );
-                detectedMarkers.back().id=id;
-                //sort the points so that they are always in the same order no matter the camera orientation
-                std::rotate ( detectedMarkers.back().begin(),detectedMarkers.back().begin() +4-nRotations,detectedMarkers.back().end() );
-            }
-            else _candidates.push_back ( MarkerCanditates[i] );
+            ws.warped[i]=1;
+            ws.ids[i]=decodeCanonical ( canonicalMarker,useCells,correctErrors,ws.rotations[i],ws.correctedBits[i] );
+            if ( timed ) lapTicks ( tick,ws.decodeTicks[i] );
+            if ( ws.ids[i]!=-1 && _cornerMethod==LINES ) refineCandidateLines( MarkerCanditates[i] ); // make LINES refinement before lose contour points
+            if ( timed ) lapTicks ( tick,ws.refineTicks[i] );
         }
-       
     }
+    if ( timed )
+    {
+        for ( int i=0;i<nCandidates;i++ )
+        {
+            ws.stats.addTicks ( DetectionStats::WARP,ws.warpTicks[i] );
+            ws.stats.addTicks ( DetectionStats::DECODE,ws.decodeTicks[i] );
+            ws.stats.addTicks ( DetectionStats::CORNER_REFINEMENT,ws.refineTicks[i] );
+        }
+    }
+    //the vector of invalid candidates is resized (not cleared) so that the memory of its elements is reused
+    size_t nInvalid=0;
+    for ( int i=0;i<nCandidates;i++ )
+        if ( ws.warped[i] && ws.ids[i]==-1 ) nInvalid++;
+    ws.stats.count ( DetectionStats::REJECTED_ID,nInvalid );
+    ws.invalidCandidates.resize ( nInvalid );
+    nInvalid=0;
+    for ( int i=0;i<nCandidates;i++ )
+    {
+        if ( !ws.warped[i] )
+        {
+            ws.stats.count ( DetectionStats::REJECTED_WARP );
+            continue;
+        }
+        if ( ws.ids[i]!=-1 )
+        {
+            detectedMarkers.push_back ( MarkerCanditates[i] );
+            detectedMarkers.back().id=ws.ids[i];
+            detectedMarkers.back().nCorrectedBits=ws.correctedBits[i];
+            //sort the points so that they are always in the same order no matter the camera orientation
+            std::rotate ( detectedMarkers.back().begin(),detectedMarkers.back().begin() +4-ws.rotations[i],detectedMarkers.back().end() );
+        }
+        else ws.invalidCandidates[nInvalid++]=MarkerCanditates[i];
+    }
+}
 
+/************************************
+ *
+ * Whether the identification functions set are the default ones, which can correct errors
+ *
+ *
+ ************************************/
+bool MarkerDetector::canCorrectErrors ( bool useCells ) const
+{
+    typedef int ( *IdentifierFunc ) ( const cv::Mat &,int & );
+    return _maxCorrectedBits>0 && ( useCells ?
+                                    markerCellsIdDetector_ptrfunc== ( IdentifierFunc ) FiducidalMarkers::detectFromCells :
+                                    markerIdDetector_ptrfunc== ( IdentifierFunc ) FiducidalMarkers::detect );
+}
 
-    ///refine the corner location if desired
-    if ( detectedMarkers.size() >0 && _cornerMethod!=NONE && _cornerMethod!=LINES )
-    {
-        vector<Point2f> Corners;
-        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
-            for ( int c=0;c<4;c++ )
-                Corners.push_back ( detectedMarkers[i][c] );
+/************************************
+ *
+ * Obtains the id of a canonical image (or of its cells if useCells) with the identification function set
+ *
+ *
+ ************************************/
+int MarkerDetector::decodeCanonical ( const cv::Mat &canonical,bool useCells,bool correctErrors,int &nRotations,int &correctedBits ) const
+{
+    correctedBits=0;
+    if ( useCells && correctErrors )
+        return FiducidalMarkers::detectFromCells ( canonical,nRotations,_maxCorrectedBits,correctedBits );
+    else if ( useCells ) return ( *markerCellsIdDetector_ptrfunc ) ( canonical,nRotations );
+    else if ( correctErrors )
+        return FiducidalMarkers::detect ( canonical,nRotations,_maxCorrectedBits,correctedBits );
+    else return ( *markerIdDetector_ptrfunc ) ( canonical,nRotations );
+}
 
-        if ( _cornerMethod==HARRIS )
-            findBestCornerInRegion_harris ( grey, Corners,7 );
-        else if ( _cornerMethod==SUBPIX )
-            cornerSubPix ( grey, Corners,cvSize ( 5,5 ), cvSize ( -1,-1 )   ,cvTermCriteria ( CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,3,0.05 ) );
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+bool MarkerDetector::identifyMarker ( const cv::Mat &grey,const vector<cv::Point2f> &corners,Marker &marker ) const throw ( cv::Exception )
+{
+    if ( grey.type() !=CV_8UC1 ) throw cv::Exception ( 9001,"grey.type()!=CV_8UC1","MarkerDetector::identifyMarker",__FILE__,__LINE__ );
+    if ( corners.size() !=4 ) throw cv::Exception ( 9001,"corners.size()!=4","MarkerDetector::identifyMarker",__FILE__,__LINE__ );
+    //the cylinder warp needs the contour of the candidate, so the plain warp is employed instead
+    bool useCells= ( markerCellsIdDetector_ptrfunc!=NULL );
+    Mat canonical,in=grey;
+    bool resW=useCells?sampleCells ( grey,canonical,_nCells,_nSamplesPerCell,corners ) :
+              warp ( in,canonical,Size ( _markerWarpSize,_markerWarpSize ),corners );
+    if ( !resW ) return false;
+    int nRotations=0,correctedBits=0;
+    int id=decodeCanonical ( canonical,useCells,canCorrectErrors ( useCells ),nRotations,correctedBits );
+    if ( id==-1 ) return false;
+    marker=Marker ( corners,id );
+    marker.nCorrectedBits=correctedBits;
+    std::rotate ( marker.begin(),marker.begin() +4-nRotations,marker.end() );
+    //refine the corners. LINES needs the contour, so that SUBPIX is employed instead. More iterations than in detect
+    //are done since the corners passed are usually less precise than these of a contour
+    if ( _cornerMethod==HARRIS )
+        findBestCornerInRegion_harris ( grey,marker,7 );
+    else if ( _cornerMethod!=NONE )
+        cornerSubPix ( grey,marker,cvSize ( 5,5 ),cvSize ( -1,-1 ),cvTermCriteria ( CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,10,0.05 ) );
+    return true;
+}
 
-        //copy back
-        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
-            for ( int c=0;c<4;c++ )     detectedMarkers[i][c]=Corners[i*4+c];
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::setPredictedMarkers ( const vector<Marker> &predicted )
+{
+    _ws.setPredictedMarkers ( predicted );
+}
+
+void MarkerDetector::Workspace::setPredictedMarkers ( const vector<Marker> &predicted )
+{
+    tracked.resize ( predicted.size() );
+    trackedIds.resize ( predicted.size() );
+    for ( size_t i=0;i<predicted.size();i++ )
+    {
+        tracked[i]=predicted[i];
+        trackedIds[i]=predicted[i].id;
     }
-    //sort by id
-    std::sort ( detectedMarkers.begin(),detectedMarkers.end() );
-    //there might be still the case that a marker is detected twice because of the double border indicated earlier,
-    //detect and remove these cases
-    vector<bool> toRemove ( detectedMarkers.size(),false );
-    for ( int i=0;i<int ( detectedMarkers.size() )-1;i++ )
+    trackedArePredicted=true;
+}
+
+/************************************
+ *
+ * Regions of the image where the markers of the previous frame are searched
+ *
+ *
+ ************************************/
+void MarkerDetector::getTrackingRois ( Workspace &ws,cv::Size imSize,float scale ) const
+{
+    ws.rois.clear();
+    cv::Rect imRect ( 0,0,imSize.width,imSize.height );
+    for ( size_t i=0;i<ws.tracked.size();i++ )
     {
-        if ( detectedMarkers[i].id==detectedMarkers[i+1].id && !toRemove[i+1] )
+        float minX=ws.tracked[i][0].x,maxX=minX,minY=ws.tracked[i][0].y,maxY=minY;
+        for ( int c=1;c<4;c++ )
         {
-            //deletes the one with smaller perimeter
-            if ( perimeter ( detectedMarkers[i] ) >perimeter ( detectedMarkers[i+1] ) ) toRemove[i+1]=true;
-            else toRemove[i]=true;
+            minX=std::min ( minX,ws.tracked[i][c].x );
+            maxX=std::max ( maxX,ws.tracked[i][c].x );
+            minY=std::min ( minY,ws.tracked[i][c].y );
+            maxY=std::max ( maxY,ws.tracked[i][c].y );
         }
+        //expand the bounding box around its center and take it to the scale of the image analyzed
+        float cx= ( minX+maxX ) /2.,cy= ( minY+maxY ) /2.;
+        float hw= ( maxX-minX ) *_roiScale/2.,hh= ( maxY-minY ) *_roiScale/2.;
+        int x0=cvFloor ( ( cx-hw ) *scale ),y0=cvFloor ( ( cy-hh ) *scale );
+        int x1=cvCeil ( ( cx+hw ) *scale ),y1=cvCeil ( ( cy+hh ) *scale );
+        cv::Rect roi=cv::Rect ( x0,y0,x1-x0+1,y1-y0+1 ) & imRect;
+        if ( roi.area() >0 ) ws.rois.push_back ( roi );
     }
-    //remove the markers marker
-    removeElements ( detectedMarkers, toRemove );
+    //join the rois that overlap so that no region is analyzed twice
+    bool merged=true;
+    while ( merged )
+    {
+        merged=false;
+        for ( size_t i=0;i<ws.rois.size() && !merged;i++ )
+            for ( size_t j=i+1;j<ws.rois.size() && !merged;j++ )
+                if ( ( ws.rois[i] & ws.rois[j] ).area() >0 )
+                {
+                    ws.rois[i]=ws.rois[i] | ws.rois[j];
+                    ws.rois.erase ( ws.rois.begin() +j );
+                    merged=true;
+                }
+    }
+}
 
-    ///detect the position of detected markers if desired
-    if ( camMatrix.rows!=0  && markerSizeMeters>0 )
+/************************************
+ *
+ * Indicates if any of the markers tracked has not been found
+ *
+ *
+ ************************************/
+bool MarkerDetector::isTrackLost ( const Workspace &ws,const vector<Marker> &detectedMarkers ) const
+{
+    //the predicted markers are optional
+    if ( ws.trackedArePredicted ) return false;
+    for ( size_t i=0;i<ws.trackedIds.size();i++ )
     {
-        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
-            detectedMarkers[i].calculateExtrinsics ( markerSizeMeters,camMatrix,distCoeff,setYPerperdicular );
+        bool found=false;
+        for ( size_t j=0;j<detectedMarkers.size() && !found;j++ )
+            found= ( detectedMarkers[j].id==ws.trackedIds[i] );
+        if ( !found ) return true;
     }
+    return false;
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::setTrackingMode ( bool enable,int fullScanPeriod,float roiScale )
+{
+    _tracking=enable;
+    _fullScanPeriod=fullScanPeriod<1?1:fullScanPeriod;
+    _roiScale=roiScale<1?1:roiScale;
+    //start again from a full scan
+    _ws.resetTracking();
 }
 
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::setPoseTracking ( bool enable,int nIterations )
+{
+    _poseTracking=enable;
+    _poseIterations=nIterations<0?0:nIterations;
+    _ws.poses.clear();
+}
 
 /************************************
  *
@@ -258,82 +790,59 @@ void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMark
  ************************************/
 void  MarkerDetector::detectRectangles ( const cv::Mat &thres,vector<std::vector<cv::Point2f> > &MarkerCanditates )
 {
-    vector<MarkerCandidate>  candidates;
-    detectRectangles(thres,candidates);
+    _ws.nCandidates=0;
+    detectRectangles(thres,_ws);
     //create the output
-    MarkerCanditates.resize(candidates.size());
+    MarkerCanditates.resize(_ws.nCandidates);
     for (size_t i=0;i<MarkerCanditates.size();i++)
-        MarkerCanditates[i]=candidates[i];
+        MarkerCanditates[i]=_ws.candidates[i];
 }
 
-void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandidate> & OutMarkerCanditates)
+void MarkerDetector::detectRectangles(const cv::Mat &thresImg,Workspace &ws,cv::Rect roi) const
 {
-    vector<MarkerCandidate>  MarkerCanditates;
+    vector<MarkerCandidate> &MarkerCanditates=ws.rectangles;
+    size_t &nRectangles=ws.nRectangles;
+    nRectangles=0;
+    if ( roi.area() ==0 ) roi=cv::Rect ( 0,0,thresImg.cols,thresImg.rows );
     //calcualte the min_max contour sizes
     int minSize=_minSize*std::max(thresImg.cols,thresImg.rows)*4;
     int maxSize=_maxSize*std::max(thresImg.cols,thresImg.rows)*4;
-    std::vector<std::vector<cv::Point> > contours2;
-    std::vector<cv::Vec4i> hierarchy2;
-
-    thresImg.copyTo ( thres2 );
-    cv::findContours ( thres2 , contours2, hierarchy2,CV_RETR_TREE, CV_CHAIN_APPROX_NONE );
-    vector<Point>  approxCurve;
-    ///for each contour, analyze if it is a paralelepiped likely to be the marker
-
-    for ( unsigned int i=0;i<contours2.size();i++ )
+    std::vector<std::vector<cv::Point> > &contours2=ws.contours;
+    int64 tick=ws.stats.tic();
+    if ( _contourMethod==BORDER_FOLLOWING )
     {
-
-
-        //check it is a possible element by first checking is has enough points
-        if ( minSize< contours2[i].size() &&contours2[i].size()<maxSize  )
+        //the contours are analyzed while they are extracted
+        findRectanglesBorderFollowing ( thresImg,ws,roi,minSize,maxSize );
+        ws.stats.toc ( DetectionStats::CONTOURS,tick );
+    }
+    else
+    {
+        std::vector<cv::Vec4i> &hierarchy2=ws.hierarchy;
+        //findContours modifies the image, so the region is copied. The contours are given in coordinates of thresImg
+        ws.thres2.create ( thresImg.size(),thresImg.type() );
+        cv::Mat roiImg=ws.thres2 ( roi );
+        thresImg ( roi ).copyTo ( roiImg );
+        cv::findContours ( roiImg , contours2, hierarchy2,CV_RETR_TREE, CV_CHAIN_APPROX_NONE,roi.tl() );
+        ws.stats.toc ( DetectionStats::CONTOURS,tick );
+        ws.stats.count ( DetectionStats::N_CONTOURS,contours2.size() );
+        ///for each contour, analyze if it is a paralelepiped likely to be the marker
+        for ( unsigned int i=0;i<contours2.size();i++ )
         {
-            //approximate to a poligon
-            approxPolyDP (  contours2[i]  ,approxCurve , double ( contours2[i].size() ) *0.05 , true );
-            // 				drawApproxCurve(copy,approxCurve,Scalar(0,0,255));
-            //check that the poligon has 4 points
-            if ( approxCurve.size() ==4 )
-            {
-
-//  	   drawContour(input,contours2[i],Scalar(255,0,225));
-//  		  namedWindow("input");
-//  		imshow("input",input);
-//  	 	waitKey(0);
-                //and is convex
-                if ( isContourConvex ( Mat ( approxCurve ) ) )
-                {
-// 					      drawApproxCurve(input,approxCurve,Scalar(255,0,255));
-// 						//ensure that the   distace between consecutive points is large enough
-                    float minDist=1e10;
-                    for ( int j=0;j<4;j++ )
-                    {
-                        float d= std::sqrt ( ( float ) ( approxCurve[j].x-approxCurve[ ( j+1 ) %4].x ) * ( approxCurve[j].x-approxCurve[ ( j+1 ) %4].x ) +
-                                             ( approxCurve[j].y-approxCurve[ ( j+1 ) %4].y ) * ( approxCurve[j].y-approxCurve[ ( j+1 ) %4].y ) );
-                        // 		norm(Mat(approxCurve[i]),Mat(approxCurve[(i+1)%4]));
-                        if ( d<minDist ) minDist=d;
-                    }
-                    //check that distance is not very small
-                    if ( minDist>10 )
-                    {
-                        //add the points
-                        // 	      cout<<"ADDED"<<endl;
-                        MarkerCanditates.push_back ( MarkerCandidate() );
-                        MarkerCanditates.back().idx=i;
-                        for ( int j=0;j<4;j++ )
-                        {
-                            MarkerCanditates.back().push_back ( Point2f ( approxCurve[j].x,approxCurve[j].y ) );
-                        }
-                    }
-                }
-            }
+            //check it is a possible element by first checking is has enough points
+            if ( minSize< contours2[i].size() &&contours2[i].size()<maxSize  )
+                addRectangle ( ws,i );
+            else ws.stats.count ( DetectionStats::REJECTED_SIZE );
         }
     }
+    ws.stats.count ( DetectionStats::N_QUADS,nRectangles );
 
 // 		 		  namedWindow("input");
 //  		imshow("input",input);
 //  						waitKey(0);
     ///sort the points in anti-clockwise order
-    valarray<bool> swapped(false,MarkerCanditates.size());//used later
-    for ( unsigned int i=0;i<MarkerCanditates.size();i++ )
+    vector<bool> &swapped=ws.swapped;//used later
+    swapped.assign ( nRectangles,false );
+    for ( unsigned int i=0;i<nRectangles;i++ )
     {
 
         //trace a line between the first and second point.
@@ -357,47 +866,295 @@ void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandi
     /// remove these elements whise corners are too close to each other
     //first detect candidates
 
-    vector<pair<int,int>  > TooNearCandidates;
-    for ( unsigned int i=0;i<MarkerCanditates.size();i++ )
+    //The average distance between the corners is an upper bound of the distance between the centers of the candidates.
+    //So, the candidates are put in a grid according to their centers, and each one is only compared with these
+    //in its cell and the neighbour ones. The cells are bigger than the distance threshold (10 pixels)
+    const int cellSize=16;
+    int gridCols=roi.width/cellSize+1,gridRows=roi.height/cellSize+1;
+    ws.gridHead.assign ( gridCols*gridRows,-1 );
+    ws.gridNext.resize ( nRectangles );
+    ws.gridCell.resize ( nRectangles );
+    for ( unsigned int i=0;i<nRectangles;i++ )
     {
-        // 	cout<<"Marker i="<<i<<MarkerCanditates[i]<<endl;
-        //calculate the average distance of each corner to the nearest corner of the other marker candidate
-        for ( unsigned int j=i+1;j<MarkerCanditates.size();j++ )
+        float cx=0,cy=0;
+        for ( int c=0;c<4;c++ )
         {
-            float dist=0;
-            for ( int c=0;c<4;c++ )
-                dist+= sqrt ( ( MarkerCanditates[i][c].x-MarkerCanditates[j][c].x ) * ( MarkerCanditates[i][c].x-MarkerCanditates[j][c].x ) + ( MarkerCanditates[i][c].y-MarkerCanditates[j][c].y ) * ( MarkerCanditates[i][c].y-MarkerCanditates[j][c].y ) );
-            dist/=4;
-            //if distance is too small
-            if ( dist< 10 )
-            {
-                TooNearCandidates.push_back ( pair<int,int> ( i,j ) );
-            }
+            cx+=MarkerCanditates[i][c].x;
+            cy+=MarkerCanditates[i][c].y;
         }
+        int col=cvFloor ( ( cx/4.-roi.x ) /cellSize ),row=cvFloor ( ( cy/4.-roi.y ) /cellSize );
+        col=std::max ( 0,std::min ( gridCols-1,col ) );
+        row=std::max ( 0,std::min ( gridRows-1,row ) );
+        ws.gridCell[i]=cv::Point ( col,row );
+        int cell=row*gridCols+col;
+        ws.gridNext[i]=ws.gridHead[cell];
+        ws.gridHead[cell]=i;
+    }
+    vector<pair<int,int>  > &TooNearCandidates=ws.tooNear;
+    TooNearCandidates.clear();
+    for ( unsigned int i=0;i<nRectangles;i++ )
+    {
+        // 	cout<<"Marker i="<<i<<MarkerCanditates[i]<<endl;
+        //calculate the average distance of each corner to the nearest corner of the other marker candidate
+        for ( int row=std::max ( 0,ws.gridCell[i].y-1 );row<=std::min ( gridRows-1,ws.gridCell[i].y+1 );row++ )
+            for ( int col=std::max ( 0,ws.gridCell[i].x-1 );col<=std::min ( gridCols-1,ws.gridCell[i].x+1 );col++ )
+                for ( int j=ws.gridHead[row*gridCols+col];j!=-1;j=ws.gridNext[j] )
+                {
+                    if ( j<= ( int ) i ) continue;//each pair is analyzed once
+                    float dist=0;
+                    for ( int c=0;c<4;c++ )
+                        dist+= sqrt ( ( MarkerCanditates[i][c].x-MarkerCanditates[j][c].x ) * ( MarkerCanditates[i][c].x-MarkerCanditates[j][c].x ) + ( MarkerCanditates[i][c].y-MarkerCanditates[j][c].y ) * ( MarkerCanditates[i][c].y-MarkerCanditates[j][c].y ) );
+                    dist/=4;
+                    //if distance is too small
+                    if ( dist< 10 )
+                    {
+                        TooNearCandidates.push_back ( pair<int,int> ( i,j ) );
+                    }
+                }
     }
        
     //mark for removal the element of  the pair with smaller perimeter
-    valarray<bool> toRemove ( false,MarkerCanditates.size() );
+    vector<bool> &toRemove=ws.toRemove;
+    toRemove.assign ( nRectangles,false );
     for ( unsigned int i=0;i<TooNearCandidates.size();i++ )
     {
         if ( perimeter ( MarkerCanditates[TooNearCandidates[i].first ] ) >perimeter ( MarkerCanditates[ TooNearCandidates[i].second] ) )
             toRemove[TooNearCandidates[i].second]=true;
         else toRemove[TooNearCandidates[i].first]=true;
     }
+    if ( ws.stats.isEnabled() )
+        ws.stats.count ( DetectionStats::REJECTED_TOO_NEAR,std::count ( toRemove.begin(),toRemove.end(),true ) );
 
     //remove the invalid ones
 //     removeElements ( MarkerCanditates,toRemove );
     //finally, assign to the remaining candidates the contour
-    OutMarkerCanditates.reserve(MarkerCanditates.size());
-    for (size_t i=0;i<MarkerCanditates.size();i++) {
+    for (size_t i=0;i<nRectangles;i++) {
         if (!toRemove[i]) {
-            OutMarkerCanditates.push_back(MarkerCanditates[i]);
-            OutMarkerCanditates.back().contour=contours2[ MarkerCanditates[i].idx];
+            MarkerCandidate &cand=Workspace::next ( ws.candidates,ws.nCandidates );
+            cand=MarkerCanditates[i];
+            cand.contour=contours2[ MarkerCanditates[i].idx];
             if (swapped[i] && _enableCylinderWarp )//if the corners where swapped, it is required to reverse here the points so that they are in the same order
-                reverse(OutMarkerCanditates.back().contour.begin(),OutMarkerCanditates.back().contour.end());//????
+                reverse(cand.contour.begin(),cand.contour.end());//????
+        }
+    }
+    ws.stats.toc ( DetectionStats::QUADS,tick );
+}
+
+/************************************
+ *
+ * Analyzes if the contour passed is a paralelepiped likely to be the marker, and adds it to ws.rectangles in that case
+ *
+ *
+ ************************************/
+bool MarkerDetector::addRectangle ( Workspace &ws,int contourIdx ) const
+{
+    const vector<Point> &contour=ws.contours[contourIdx];
+    vector<Point>  &approxCurve=ws.approxCurve;
+    //approximate to a poligon
+    approxPolyDP (  contour  ,approxCurve , double ( contour.size() ) *0.05 , true );
+    // 				drawApproxCurve(copy,approxCurve,Scalar(0,0,255));
+    //check that the poligon has 4 points
+    //and is convex
+    if ( approxCurve.size() !=4 || !isContourConvex ( Mat ( approxCurve ) ) )
+    {
+        ws.stats.count ( DetectionStats::REJECTED_SHAPE );
+        return false;
+    }
+// 						//ensure that the   distace between consecutive points is large enough
+    float minDist=1e10;
+    for ( int j=0;j<4;j++ )
+    {
+        float d= std::sqrt ( ( float ) ( approxCurve[j].x-approxCurve[ ( j+1 ) %4].x ) * ( approxCurve[j].x-approxCurve[ ( j+1 ) %4].x ) +
+                             ( approxCurve[j].y-approxCurve[ ( j+1 ) %4].y ) * ( approxCurve[j].y-approxCurve[ ( j+1 ) %4].y ) );
+        // 		norm(Mat(approxCurve[i]),Mat(approxCurve[(i+1)%4]));
+        if ( d<minDist ) minDist=d;
+    }
+    //check that distance is not very small
+    if ( minDist<=10 )
+    {
+        ws.stats.count ( DetectionStats::REJECTED_SHAPE );
+        return false;
+    }
+    //add the points
+    MarkerCandidate &cand=Workspace::next ( ws.rectangles,ws.nRectangles );
+    cand.idx=contourIdx;
+    for ( int j=0;j<4;j++ )
+    {
+        cand.push_back ( Point2f ( approxCurve[j].x,approxCurve[j].y ) );
+    }
+    return true;
+}
+
+/************************************
+ *
+ * Extraction of the contours of the region roi of a thresholded image by border following (Suzuki and Abe,
+ * Topological structural analysis of digitized binary images by border following, 1985), as in cv::findContours
+ * without hierarchy. Each contour is analyzed as soon as it is traced: these with a size out of (minSize,maxSize)
+ * are not stored, and only the ones that are rectangles are kept in ws.contours
+ *
+ ************************************/
+void MarkerDetector::findRectanglesBorderFollowing ( const cv::Mat &thresImg,Workspace &ws,cv::Rect roi,int minSize,int maxSize ) const
+{
+    int w=roi.width,h=roi.height;
+    //number of contours kept. The rest of elements of ws.contours are kept to reuse their memory
+    size_t nContours=0;
+    if ( w>=3 && h>=3 )
+    {
+        //labels: 0 background, 1 foreground not visited yet, 2 border visited, -2 border visited whose right pixel is background.
+        //As in cv::findContours, the pixels in the limits of the region are considered background
+        ws.labels.create ( thresImg.size(),CV_8SC1 );
+        cv::Mat lab=ws.labels ( cv::Rect ( 0,0,w,h ) );
+        for ( int y=0;y<h;y++ )
+        {
+            schar *l=lab.ptr<schar> ( y );
+            const uchar *t=thresImg.ptr<uchar> ( y+roi.y ) +roi.x;
+            l[0]=l[w-1]=0;
+            if ( y==0 || y==h-1 ) memset ( l,0,w );
+            else for ( int x=1;x<w-1;x++ ) l[x]= ( t[x]!=0 );
+        }
+        //offsets of the 8 neighbours in counterclockwise order, starting from the right one (repeated to avoid the modulus)
+        int step=lab.step;
+        int deltas[16]={1,-step+1,-step,-step-1,-1,step-1,step,step+1,1,-step+1,-step,-step-1,-1,step-1,step,step+1};
+        const cv::Point codeDeltas[8]={cv::Point ( 1,0 ),cv::Point ( 1,-1 ),cv::Point ( 0,-1 ),cv::Point ( -1,-1 ),cv::Point ( -1,0 ),cv::Point ( -1,1 ),cv::Point ( 0,1 ),cv::Point ( 1,1 ) };
+
+        for ( int y=1;y<h-1;y++ )
+        {
+            schar *row=lab.ptr<schar> ( y );
+            schar prev=row[0];
+            for ( int x=1;x<w-1;x++ )
+            {
+                schar p=row[x];
+                if ( p==prev ) continue;
+                //an outer border starts in x, and a hole border in x-1
+                bool isHole;
+                if ( prev==0 && p==1 ) isHole=false;
+                else if ( p==0 && prev>=1 ) isHole=true;
+                else
+                {
+                    prev=p;
+                    continue;
+                }
+                //the contour is traced in the first free element of ws.contours
+                if ( nContours==ws.contours.size() ) ws.contours.resize ( nContours+1 );
+                vector<cv::Point> &contour=ws.contours[nContours];
+                contour.clear();
+                cv::Point pt ( isHole?x-1:x,y );
+                schar *i0=row+pt.x,*i1=0,*i3,*i4;
+                int s=isHole?0:4,sEnd=s;
+                int size=0;
+                //look for the first non zero neighbour in clockwise order
+                do
+                {
+                    s= ( s-1 ) &7;
+                    i1=i0+deltas[s];
+                    if ( *i1!=0 ) break;
+                }
+                while ( s!=sEnd );
+                if ( s==sEnd ) //isolated pixel
+                {
+                    *i0=-2;
+                    size=1;
+                }
+                else
+                {
+                    i3=i0;
+                    for ( ;; )
+                    {
+                        sEnd=s;
+                        //next non zero neighbour in counterclockwise order
+                        for ( ;; )
+                        {
+                            i4=i3+deltas[++s];
+                            if ( *i4!=0 ) break;
+                        }
+                        s&=7;
+                        //mark the pixel. If its right pixel has been examined, it is background
+                        if ( ( unsigned ) ( s-1 ) < ( unsigned ) sEnd ) *i3=-2;
+                        else if ( *i3==1 ) *i3=2;
+                        //the points are not stored once the contour is known to be too large
+                        if ( size<maxSize ) contour.push_back ( cv::Point ( pt.x+roi.x,pt.y+roi.y ) );
+                        size++;
+                        if ( i4==i0 && i3==i1 ) break;
+                        i3=i4;
+                        pt+=codeDeltas[s];
+                        s= ( s+4 ) &7;
+                    }
+                }
+                //keep the contour only if it is a rectangle
+                ws.stats.count ( DetectionStats::N_CONTOURS );
+                if ( ! ( minSize<size && size<maxSize ) ) ws.stats.count ( DetectionStats::REJECTED_SIZE );
+                else if ( addRectangle ( ws,nContours ) ) nContours++;
+                p=row[x];
+                prev=p;
+            }
         }
     }
+}
+
+/************************************
+ *
+ * Reallocations of the workspace buffers
+ *
+ *
+ ************************************/
+void MarkerDetector::Workspace::getState ( vector<size_t> &state ) const
+{
+    //the address of the data of each buffer. If it changes, the buffer has been reallocated
+    state.clear();
+    state.push_back ( greyIsInput?0: ( size_t ) grey.data );
+    state.push_back ( ( size_t ) thres.data );
+    state.push_back ( ( size_t ) thres2.data );
+    state.push_back ( ( size_t ) integralImg.data );
+    state.push_back ( ( size_t ) labels.data );
+    for ( size_t i=0;i<pyramid.size();i++ ) state.push_back ( ( size_t ) pyramid[i].data );
+    for ( size_t i=0;i<canonicalMarkers.size();i++ ) state.push_back ( ( size_t ) canonicalMarkers[i].data );
+    //the vectors only reallocate when their capacity grows. The vectors of points of the contours and candidates are kept too,
+    //and the sum of their capacities only changes if any of them grows
+    size_t inner=0;
+    for ( size_t i=0;i<contours.size();i++ ) inner+=contours[i].capacity();
+    for ( size_t i=0;i<rectangles.size();i++ ) inner+=rectangles[i].capacity() +rectangles[i].contour.capacity();
+    for ( size_t i=0;i<candidates.size();i++ ) inner+=candidates[i].capacity() +candidates[i].contour.capacity();
+    for ( size_t i=0;i<tracked.size();i++ ) inner+=tracked[i].capacity();
+    for ( size_t i=0;i<invalidCandidates.size();i++ ) inner+=invalidCandidates[i].capacity();
+    state.push_back ( inner );
+    state.push_back ( contours.capacity() );
+    state.push_back ( hierarchy.capacity() );
+    state.push_back ( approxCurve.capacity() );
+    state.push_back ( rectangles.capacity() );
+    state.push_back ( candidates.capacity() );
+    state.push_back ( swapped.capacity() );
+    state.push_back ( toRemove.capacity() );
+    state.push_back ( tooNear.capacity() );
+    state.push_back ( gridHead.capacity() );
+    state.push_back ( gridNext.capacity() );
+    state.push_back ( gridCell.capacity() );
+    state.push_back ( ids.capacity() );
+    state.push_back ( rotations.capacity() );
+    state.push_back ( warped.capacity() );
+    state.push_back ( correctedBits.capacity() );
+    state.push_back ( corners.capacity() );
+    state.push_back ( warpTicks.capacity() );
+    state.push_back ( decodeTicks.capacity() );
+    state.push_back ( refineTicks.capacity() );
+    state.push_back ( tracked.capacity() );
+    state.push_back ( trackedIds.capacity() );
+    state.push_back ( rois.capacity() );
+    state.push_back ( thresRois.capacity() );
+    state.push_back ( invalidCandidates.capacity() );
+    state.push_back ( harris.dxx.capacity() +harris.dxy.capacity() +harris.dyy.capacity() +harris.hxx.capacity() +harris.hxy.capacity() +
+                      harris.hyy.capacity() +harris.response.capacity() +harris.candidates.capacity() +harris.features.capacity() );
+}
 
+void MarkerDetector::Workspace::updateReallocations()
+{
+    getState ( _state );
+    for ( size_t i=0;i<_state.size();i++ )
+    {
+        //a new element (e.g., a new pyramid level) counts if it has memory
+        if ( i>=_prevState.size() ) { if ( _state[i]!=0 ) nReallocations++; }
+        else if ( _state[i]!=_prevState[i] ) nReallocations++;
+    }
+    _state.swap ( _prevState );
 }
 
 /************************************
@@ -407,6 +1164,11 @@ void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandi
  *
  ************************************/
 void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double param1,double param2 ) throw ( cv::Exception )
+{
+    thresHold ( method,grey,out,param1,param2,_ws );
+}
+
+void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double param1,double param2,Workspace &ws ) const throw ( cv::Exception )
 {
 
     if (param1==-1) param1=_thresParam1;
@@ -425,6 +1187,11 @@ void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double para
 
         cv::adaptiveThreshold ( grey,out,255,ADAPTIVE_THRESH_MEAN_C,THRESH_BINARY_INV,param1,param2 );
         break;
+    case ADPT_THRES_INTEGRAL:
+        if ( param1<3 ) param1=3;
+        else if ( ( ( int ) param1 ) %2 !=1 ) param1= ( int ) ( param1+1 );
+        adaptiveThresholdIntegral ( grey,out,param1,param2,ws.integralImg );
+        break;
     case CANNY:
     {
         //this should be the best method, and generally it is.
@@ -441,25 +1208,191 @@ void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double para
     break;
     }
 }
+
+#if defined(__SSE2__) && !defined(__AVX2__)
+/**Low 32 bits of the product of the 32 bit integers (_mm_mullo_epi32 is not available until SSE4.1)
+ */
+static inline __m128i mullo_epi32_sse2 ( __m128i a,__m128i b )
+{
+    __m128i p02=_mm_mul_epu32 ( a,b );
+    __m128i p13=_mm_mul_epu32 ( _mm_srli_si128 ( a,4 ),_mm_srli_si128 ( b,4 ) );
+    return _mm_unpacklo_epi32 ( _mm_shuffle_epi32 ( p02,_MM_SHUFFLE ( 0,0,2,0 ) ),_mm_shuffle_epi32 ( p13,_MM_SHUFFLE ( 0,0,2,0 ) ) );
+}
+#endif
+
+/************************************
+ *
+ * Mean-C adaptive threshold using the integral image.
+ * A pixel is set (255) if src+C <= mean of its blockSize x blockSize neighborhood. To avoid divisions and to
+ * round the mean as cv::adaptiveThreshold does, the comparison is evaluated as  (2*(src+C)-1)*area <= 2*sum
+ *
+ ************************************/
+void MarkerDetector::adaptiveThresholdIntegral ( const Mat &grey,Mat &out,int blockSize,double C,Mat &integralImg ) const
+{
+    cv::integral ( grey,integralImg,CV_32S );
+    out.create ( grey.size(),CV_8UC1 );
+    const int half=blockSize/2;
+    const int iC=cvFloor ( C ); //as in cv::adaptiveThreshold for THRESH_BINARY_INV
+    const int rows=grey.rows,cols=grey.cols;
+    //first and last columns for which the neighborhood is entirely into the image
+    const int xStart=std::min ( half,cols ),xEnd=std::max ( xStart,cols-half-1 );
+    //the image is divided in horizontal bands processed in parallel
+    const int nBands=std::max ( 1,std::min ( _nThreads,rows ) );
+    const int bandHeight= ( rows+nBands-1 ) /nBands;
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(nBands) schedule(static) if(nBands>1)
+#endif
+    for ( int b=0;b<nBands;b++ )
+    {
+        int yEnd=std::min ( rows, ( b+1 ) *bandHeight );
+        for ( int y=b*bandHeight;y<yEnd;y++ )
+        {
+            int y0=std::max ( 0,y-half ),y1=std::min ( rows,y+half+1 );
+            const int *top=integralImg.ptr<int> ( y0 );
+            const int *bottom=integralImg.ptr<int> ( y1 );
+            const uchar *src=grey.ptr<uchar> ( y );
+            uchar *dst=out.ptr<uchar> ( y );
+            //borders (left and right), where the neighborhood is clipped
+            for ( int x=0;x<cols;x++ )
+            {
+                if ( x==xStart ) x=xEnd;
+                int x0=std::max ( 0,x-half ),x1=std::min ( cols,x+half+1 );
+                int area= ( x1-x0 ) * ( y1-y0 );
+                int sum=bottom[x1]-bottom[x0]-top[x1]+top[x0];
+                dst[x]= ( ( 2* ( src[x]+iC )-1 ) *area<=2*sum ) ?255:0;
+            }
+            //central part. The area of the neighborhood is constant along the row
+            const int area=blockSize* ( y1-y0 );
+            const int *tl=top- half,*tr=top+half+1,*bl=bottom-half,*br=bottom+half+1;
+            int x=xStart;
+#ifdef __AVX2__
+            const __m256i vArea=_mm256_set1_epi32 ( area ),vOff=_mm256_set1_epi32 ( 2*iC-1 ),v255=_mm256_set1_epi32 ( 255 );
+            for ( ;x+8<=xEnd;x+=8 )
+            {
+                __m256i sum=_mm256_sub_epi32 ( _mm256_add_epi32 ( _mm256_loadu_si256 ( ( const __m256i* ) ( br+x ) ),_mm256_loadu_si256 ( ( const __m256i* ) ( tl+x ) ) ),
+                                               _mm256_add_epi32 ( _mm256_loadu_si256 ( ( const __m256i* ) ( bl+x ) ),_mm256_loadu_si256 ( ( const __m256i* ) ( tr+x ) ) ) );
+                __m256i val=_mm256_cvtepu8_epi32 ( _mm_loadl_epi64 ( ( const __m128i* ) ( src+x ) ) );
+                __m256i lhs=_mm256_mullo_epi32 ( _mm256_add_epi32 ( _mm256_add_epi32 ( val,val ),vOff ),vArea );
+                __m256i res=_mm256_andnot_si256 ( _mm256_cmpgt_epi32 ( lhs,_mm256_add_epi32 ( sum,sum ) ),v255 );
+                __m128i res16=_mm_packs_epi32 ( _mm256_castsi256_si128 ( res ),_mm256_extracti128_si256 ( res,1 ) );
+                _mm_storel_epi64 ( ( __m128i* ) ( dst+x ),_mm_packus_epi16 ( res16,res16 ) );
+            }
+#elif defined(__SSE2__)
+            const __m128i vArea=_mm_set1_epi32 ( area ),vOff=_mm_set1_epi32 ( 2*iC-1 ),v255=_mm_set1_epi32 ( 255 ),zero=_mm_setzero_si128();
+            for ( ;x+8<=xEnd;x+=8 )
+            {
+                __m128i val16=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( src+x ) ),zero );
+                __m128i res[2];
+                for ( int h=0;h<2;h++ )
+                {
+                    int xx=x+4*h;
+                    __m128i sum=_mm_sub_epi32 ( _mm_add_epi32 ( _mm_loadu_si128 ( ( const __m128i* ) ( br+xx ) ),_mm_loadu_si128 ( ( const __m128i* ) ( tl+xx ) ) ),
+                                                _mm_add_epi32 ( _mm_loadu_si128 ( ( const __m128i* ) ( bl+xx ) ),_mm_loadu_si128 ( ( const __m128i* ) ( tr+xx ) ) ) );
+                    __m128i val= h==0?_mm_unpacklo_epi16 ( val16,zero ) :_mm_unpackhi_epi16 ( val16,zero );
+                    __m128i lhs=mullo_epi32_sse2 ( _mm_add_epi32 ( _mm_add_epi32 ( val,val ),vOff ),vArea );
+                    res[h]=_mm_andnot_si128 ( _mm_cmpgt_epi32 ( lhs,_mm_add_epi32 ( sum,sum ) ),v255 );
+                }
+                __m128i res16=_mm_packs_epi32 ( res[0],res[1] );
+                _mm_storel_epi64 ( ( __m128i* ) ( dst+x ),_mm_packus_epi16 ( res16,res16 ) );
+            }
+#endif
+            for ( ;x<xEnd;x++ )
+            {
+                int sum=br[x]-bl[x]-tr[x]+tl[x];
+                dst[x]= ( ( 2* ( src[x]+iC )-1 ) *area<=2*sum ) ?255:0;
+            }
+        }
+    }
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+//homography that maps the unit square into the quadrilateral, so that (0,0),(1,0),(1,1),(0,1) go to points[0..3]
+//(Heckbert, Fundamentals of texture mapping and image warping, 1989). It is calculated directly, without solving any system.
+//Returns false if the quadrilateral is degenerated
+static bool unitSquareHomography ( const vector<Point2f> &points,double H[9] )
+{
+    double x0=points[0].x,y0=points[0].y,x1=points[1].x,y1=points[1].y;
+    double x2=points[2].x,y2=points[2].y,x3=points[3].x,y3=points[3].y;
+    double sumX=x0-x1+x2-x3,sumY=y0-y1+y2-y3;
+    double dx1=x1-x2,dx2=x3-x2,dy1=y1-y2,dy2=y3-y2;
+    double den=dx1*dy2-dx2*dy1;
+    if ( fabs ( den ) <1e-6 ) return false;
+    double g= ( sumX*dy2-dx2*sumY ) /den,h= ( dx1*sumY-sumX*dy1 ) /den;
+    H[0]=x1-x0+g*x1;H[1]=x3-x0+h*x3;H[2]=x0;
+    H[3]=y1-y0+g*y1;H[4]=y3-y0+h*y3;H[5]=y0;
+    H[6]=g;H[7]=h;H[8]=1;
+    return true;
+}
+
 /************************************
  *
  *
  *
  *
  ************************************/
-bool MarkerDetector::warp ( Mat &in,Mat &out,Size size, vector<Point2f> points ) throw ( cv::Exception )
+bool MarkerDetector::warp ( Mat &in,Mat &out,Size size, const vector<Point2f> &points ) const throw ( cv::Exception )
 {
 
     if ( points.size() !=4 )    throw cv::Exception ( 9001,"point.size()!=4","MarkerDetector::warp",__FILE__,__LINE__ );
-    //obtain the perspective transform
-    Point2f  pointsRes[4],pointsIn[4];
-    for ( int i=0;i<4;i++ ) pointsIn[i]=points[i];
-    pointsRes[0]= ( Point2f ( 0,0 ) );
-    pointsRes[1]= Point2f ( size.width-1,0 );
-    pointsRes[2]= Point2f ( size.width-1,size.height-1 );
-    pointsRes[3]= Point2f ( 0,size.height-1 );
-    Mat M=getPerspectiveTransform ( pointsIn,pointsRes );
-    cv::warpPerspective ( in, out,  M, size,cv::INTER_NEAREST );
+    //obtain the perspective transform from the canonical image to the input one. It is kept in a header over H
+    //instead of calling getPerspectiveTransform, so that no memory is allocated for each candidate
+    double H[9];
+    if ( !unitSquareHomography ( points,H ) ) return false;
+    //the unit square is scaled to the size of the output
+    for ( int r=0;r<3;r++ )
+    {
+        H[r*3]/= ( size.width-1 );
+        H[r*3+1]/= ( size.height-1 );
+    }
+    Mat M ( 3,3,CV_64FC1,H );
+    cv::warpPerspective ( in, out,  M, size,cv::INTER_NEAREST|cv::WARP_INVERSE_MAP );
+    return true;
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+bool MarkerDetector::sampleCells ( const Mat &in,Mat &cells,int nCells,int nSamplesPerCell,const vector<Point2f> &points ) const throw ( cv::Exception )
+{
+    if ( points.size() !=4 )    throw cv::Exception ( 9001,"point.size()!=4","MarkerDetector::sampleCells",__FILE__,__LINE__ );
+    if ( in.type() !=CV_8UC1 )     throw cv::Exception ( 9001,"in.type()!=CV_8UC1","MarkerDetector::sampleCells",__FILE__,__LINE__ );
+    double H[9];
+    if ( !unitSquareHomography ( points,H ) ) return false;
+
+    cells.create ( nCells,nCells,CV_8UC1 );
+    int nSamples=nSamplesPerCell*nSamplesPerCell;
+    double step=1./double ( nCells*nSamplesPerCell );
+    for ( int cy=0;cy<nCells;cy++ )
+    {
+        uchar *cellsPtr=cells.ptr<uchar> ( cy );
+        for ( int cx=0;cx<nCells;cx++ )
+        {
+            //the samples are placed at the center of the sub-cells
+            int sum=0;
+            for ( int sy=0;sy<nSamplesPerCell;sy++ )
+            {
+                double v= ( cy*nSamplesPerCell+sy+0.5 ) *step;
+                for ( int sx=0;sx<nSamplesPerCell;sx++ )
+                {
+                    double u= ( cx*nSamplesPerCell+sx+0.5 ) *step;
+                    double w=H[6]*u+H[7]*v+1;
+                    int px=cvRound ( ( H[0]*u+H[1]*v+H[2] ) /w ),py=cvRound ( ( H[3]*u+H[4]*v+H[5] ) /w );
+                    px=std::max ( 0,std::min ( in.cols-1,px ) );
+                    py=std::max ( 0,std::min ( in.rows-1,py ) );
+                    sum+=in.ptr<uchar> ( py ) [px];
+                }
+            }
+            cellsPtr[cx]= ( sum+nSamples/2 ) /nSamples;
+        }
+    }
     return true;
 }
 
@@ -551,7 +1484,7 @@ void setPointIntoImage(cv::Point  &p,cv::Size s) {
  *
  *
  ************************************/
-bool MarkerDetector::warp_cylinder ( Mat &in,Mat &out,Size size, MarkerCandidate& mcand ) throw ( cv::Exception )
+bool MarkerDetector::warp_cylinder ( Mat &in,Mat &out,Size size, MarkerCandidate& mcand ) const throw ( cv::Exception )
 {
 
     if ( mcand.size() !=4 )    throw cv::Exception ( 9001,"point.size()!=4","MarkerDetector::warp",__FILE__,__LINE__ );
@@ -694,7 +1627,7 @@ return true;
  *
  *
  ************************************/
-bool MarkerDetector::isInto ( Mat &contour,vector<Point2f> &b )
+bool MarkerDetector::isInto ( Mat &contour,vector<Point2f> &b ) const
 {
 
     for ( unsigned int i=0;i<b.size();i++ )
@@ -707,7 +1640,7 @@ bool MarkerDetector::isInto ( Mat &contour,vector<Point2f> &b )
  *
  *
  ************************************/
-int MarkerDetector:: perimeter ( vector<Point2f> &a )
+int MarkerDetector:: perimeter ( vector<Point2f> &a ) const
 {
     int sum=0;
     for ( unsigned int i=0;i<a.size();i++ )
@@ -723,7 +1656,169 @@ int MarkerDetector:: perimeter ( vector<Point2f> &a )
  *
  *
  */
-void MarkerDetector::findBestCornerInRegion_harris ( const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize )
+void MarkerDetector::findBestCornerInRegion_harris ( const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize ) const
+{
+    Workspace::HarrisBuffers buffers;
+    findBestCornerInRegion_harris ( grey,Corners,blockSize,buffers );
+}
+
+/**
+ *
+ * Each corner is moved to the corner point nearest to it in its window, selected as cv::goodFeaturesToTrack does (up to 10 local
+ * maxima of the minimum eigenvalue above 0.001 of the maximum, the strongest first, at a distance of halfSize at least), but
+ * computing the gradients on the image instead of on a copy of the window, and with buffers shared by all the corners.
+ * Out of the image, the rows and columns of its limits are replicated
+ */
+void MarkerDetector::findBestCornerInRegion_harris ( const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize,Workspace::HarrisBuffers &buffers ) const
+{
+    const int halfSize=blockSize/2;
+    const int maxFeatures=10;
+    const double qualityLevel=0.001;
+    //the structure tensor of a pixel is the sum of the products of the gradients in its 3x3 neighborhood, so that the gradients
+    //are required in a margin of 1 pixel around the window, and the pixels in a margin of 2
+    const int gSize=blockSize+2;
+    vector<int> &dxx=buffers.dxx,&dxy=buffers.dxy,&dyy=buffers.dyy;
+    vector<int> &hxx=buffers.hxx,&hxy=buffers.hxy,&hyy=buffers.hyy;
+    vector<float> &response=buffers.response;
+    vector<pair<float,int> > &candidates=buffers.candidates;
+    vector<cv::Point> &features=buffers.features;
+    dxx.resize ( gSize*gSize );
+    dxy.resize ( gSize*gSize );
+    dyy.resize ( gSize*gSize );
+    hxx.resize ( gSize*blockSize );
+    hxy.resize ( gSize*blockSize );
+    hyy.resize ( gSize*blockSize );
+    response.resize ( blockSize*blockSize );
+    candidates.reserve ( blockSize*blockSize );
+    features.reserve ( maxFeatures );
+    const int lastCol=grey.cols-1,lastRow=grey.rows-1;
+    for ( size_t i=0;i<Corners.size();i++ )
+    {
+        //window as in the previous implementation, which must be into the image
+        if ( Corners[i].x-halfSize<0 || Corners[i].y-halfSize<0 || Corners[i].x+halfSize>=grey.cols || Corners[i].y+halfSize>=grey.rows ) continue;
+        int x0=int ( Corners[i].x-halfSize ),y0=int ( Corners[i].y-halfSize );
+        //sobel gradients and their products in the window and its margin
+        for ( int gy=0;gy<gSize;gy++ )
+        {
+            int y=y0-1+gy,xs=x0-1;
+            const uchar *pm=grey.ptr<uchar> ( std::max ( 0,std::min ( lastRow,y-1 ) ) );
+            const uchar *p=grey.ptr<uchar> ( std::max ( 0,std::min ( lastRow,y ) ) );
+            const uchar *pp=grey.ptr<uchar> ( std::max ( 0,std::min ( lastRow,y+1 ) ) );
+            int *rxx=&dxx[gy*gSize],*rxy=&dxy[gy*gSize],*ryy=&dyy[gy*gSize];
+            int gx=0;
+#ifdef __SSE2__
+            const __m128i zero=_mm_setzero_si128();
+            //only where the 8+2 columns read are into the image
+            for ( ;xs-1>=0 && xs+gx+8<=lastCol && gx+8<=gSize;gx+=8 )
+            {
+                int x=xs+gx;
+                __m128i m0=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( pm+x-1 ) ),zero );
+                __m128i m1=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( pm+x ) ),zero );
+                __m128i m2=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( pm+x+1 ) ),zero );
+                __m128i c0=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( p+x-1 ) ),zero );
+                __m128i c2=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( p+x+1 ) ),zero );
+                __m128i p0=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( pp+x-1 ) ),zero );
+                __m128i p1=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( pp+x ) ),zero );
+                __m128i p2=_mm_unpacklo_epi8 ( _mm_loadl_epi64 ( ( const __m128i* ) ( pp+x+1 ) ),zero );
+                __m128i c=_mm_sub_epi16 ( c2,c0 );
+                __m128i ix=_mm_add_epi16 ( _mm_add_epi16 ( _mm_sub_epi16 ( m2,m0 ),_mm_sub_epi16 ( p2,p0 ) ),_mm_add_epi16 ( c,c ) );
+                __m128i iy=_mm_sub_epi16 ( _mm_add_epi16 ( _mm_add_epi16 ( p0,p2 ),_mm_add_epi16 ( p1,p1 ) ),
+                                           _mm_add_epi16 ( _mm_add_epi16 ( m0,m2 ),_mm_add_epi16 ( m1,m1 ) ) );
+                //products of 16 bit values, widened to 32 bits
+                __m128i lo,hi;
+                lo=_mm_mullo_epi16 ( ix,ix );
+                hi=_mm_mulhi_epi16 ( ix,ix );
+                _mm_storeu_si128 ( ( __m128i* ) ( rxx+gx ),_mm_unpacklo_epi16 ( lo,hi ) );
+                _mm_storeu_si128 ( ( __m128i* ) ( rxx+gx+4 ),_mm_unpackhi_epi16 ( lo,hi ) );
+                lo=_mm_mullo_epi16 ( ix,iy );
+                hi=_mm_mulhi_epi16 ( ix,iy );
+                _mm_storeu_si128 ( ( __m128i* ) ( rxy+gx ),_mm_unpacklo_epi16 ( lo,hi ) );
+                _mm_storeu_si128 ( ( __m128i* ) ( rxy+gx+4 ),_mm_unpackhi_epi16 ( lo,hi ) );
+                lo=_mm_mullo_epi16 ( iy,iy );
+                hi=_mm_mulhi_epi16 ( iy,iy );
+                _mm_storeu_si128 ( ( __m128i* ) ( ryy+gx ),_mm_unpacklo_epi16 ( lo,hi ) );
+                _mm_storeu_si128 ( ( __m128i* ) ( ryy+gx+4 ),_mm_unpackhi_epi16 ( lo,hi ) );
+            }
+#endif
+            for ( ;gx<gSize;gx++ )
+            {
+                int x=xs+gx;
+                int xm=std::max ( 0,std::min ( lastCol,x-1 ) ),xc=std::max ( 0,std::min ( lastCol,x ) ),xp=std::max ( 0,std::min ( lastCol,x+1 ) );
+                int ix= ( pm[xp]-pm[xm] ) +2* ( p[xp]-p[xm] ) + ( pp[xp]-pp[xm] );
+                int iy= ( pp[xm]+2*pp[xc]+pp[xp] )- ( pm[xm]+2*pm[xc]+pm[xp] );
+                rxx[gx]=ix*ix;
+                rxy[gx]=ix*iy;
+                ryy[gx]=iy*iy;
+            }
+        }
+        //3x3 sums of the products (horizontal and then vertical), and minimum eigenvalue of the structure tensor
+        for ( int gy=0;gy<gSize;gy++ )
+            for ( int x=0;x<blockSize;x++ )
+            {
+                int k=gy*gSize+x;
+                hxx[gy*blockSize+x]=dxx[k]+dxx[k+1]+dxx[k+2];
+                hxy[gy*blockSize+x]=dxy[k]+dxy[k+1]+dxy[k+2];
+                hyy[gy*blockSize+x]=dyy[k]+dyy[k+1]+dyy[k+2];
+            }
+        float maxResponse=0;
+        for ( int y=0;y<blockSize;y++ )
+            for ( int x=0;x<blockSize;x++ )
+            {
+                int k=y*blockSize+x;
+                double a=hxx[k]+hxx[k+blockSize]+hxx[k+2*blockSize];
+                double b=hxy[k]+hxy[k+blockSize]+hxy[k+2*blockSize];
+                double c=hyy[k]+hyy[k+blockSize]+hyy[k+2*blockSize];
+                float r= ( a+c-sqrt ( ( a-c ) * ( a-c ) +4*b*b ) ) /2;
+                response[k]=r;
+                maxResponse=std::max ( maxResponse,r );
+            }
+        if ( maxResponse<=0 ) continue;
+        //local maxima above the quality level, excluding the border of the window
+        float threshold=maxResponse*qualityLevel;
+        candidates.clear();
+        for ( int y=1;y<blockSize-1;y++ )
+            for ( int x=1;x<blockSize-1;x++ )
+            {
+                const float *r=&response[y*blockSize+x];
+                if ( *r<=threshold ) continue;
+                bool isMax=true;
+                for ( int dy=-1;dy<=1 && isMax;dy++ )
+                    for ( int dx=-1;dx<=1 && isMax;dx++ )
+                        isMax=r[dy*blockSize+dx]<=*r;
+                if ( isMax ) candidates.push_back ( make_pair ( -*r,y*blockSize+x ) );
+            }
+        //the strongest first, discarding these too near to the ones taken
+        std::sort ( candidates.begin(),candidates.end() );
+        features.clear();
+        for ( size_t j=0;j<candidates.size() && ( int ) features.size() <maxFeatures;j++ )
+        {
+            cv::Point f ( candidates[j].second%blockSize,candidates[j].second/blockSize );
+            bool farEnough=true;
+            for ( size_t k=0;k<features.size() && farEnough;k++ )
+                farEnough= ( f.x-features[k].x ) * ( f.x-features[k].x ) + ( f.y-features[k].y ) * ( f.y-features[k].y ) >=halfSize*halfSize;
+            if ( farEnough ) features.push_back ( f );
+        }
+        //the one nearest to the center
+        float minD=9999;
+        int bIdx=-1;
+        for ( size_t j=0;j<features.size();j++ )
+        {
+            float dist=sqrt ( float ( ( features[j].x-halfSize ) * ( features[j].x-halfSize ) + ( features[j].y-halfSize ) * ( features[j].y-halfSize ) ) );
+            if ( dist<minD )
+            {
+                minD=dist;
+                bIdx=j;
+            }
+        }
+        if ( bIdx!=-1 && minD<halfSize ) Corners[i]+=cv::Point2f ( features[bIdx].x-halfSize,features[bIdx].y-halfSize );
+    }
+}
+
+/**
+ *
+ *
+ */
+void MarkerDetector::findBestCornerInRegion_harris_goodFeatures ( const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize ) const
 {
     int halfSize=blockSize/2;
     for ( size_t i=0;i<Corners.size();i++ )
@@ -748,8 +1843,9 @@ void MarkerDetector::findBestCornerInRegion_harris ( const cv::Mat  & grey,vecto
                     minD=dist;
                     bIdx=j;
                 }
-                if ( minD<halfSize ) Corners[i]+= ( corners2[bIdx]-Center );
             }
+            //the offset of the nearest one is applied once, after all of them have been examined
+            if ( bIdx!=-1 && minD<halfSize ) Corners[i]+= ( corners2[bIdx]-Center );
         }
     }
 }
@@ -759,7 +1855,7 @@ void MarkerDetector::findBestCornerInRegion_harris ( const cv::Mat  & grey,vecto
  *
  *
  */
-void MarkerDetector::refineCandidateLines(MarkerDetector::MarkerCandidate& candidate)
+void MarkerDetector::refineCandidateLines(MarkerDetector::MarkerCandidate& candidate) const
 {
       // search corners on the contour vector
       vector<unsigned int> cornerIndex;
@@ -816,7 +1912,7 @@ void MarkerDetector::refineCandidateLines(MarkerDetector::MarkerCandidate& candi
 
 /**
  */
-void MarkerDetector::interpolate2Dline( const std::vector< Point >& inPoints, Point3f& outLine)
+void MarkerDetector::interpolate2Dline( const std::vector< Point >& inPoints, Point3f& outLine) const
 {
   
   float minX, maxX, minY, maxY;
@@ -871,7 +1967,7 @@ void MarkerDetector::interpolate2Dline( const std::vector< Point >& inPoints, Po
 
 /**
  */
-Point2f MarkerDetector::getCrossPoint(const cv::Point3f& line1, const cv::Point3f& line2)
+Point2f MarkerDetector::getCrossPoint(const cv::Point3f& line1, const cv::Point3f& line2) const
 {
   
     // create matrices of equation system
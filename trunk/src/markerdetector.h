@@ -33,6 +33,7 @@ or implied, of Rafael Muñoz Salinas.
 #include "cameraparameters.h"
 #include "exports.h"
 #include "marker.h"
+#include "detectionstats.h"
 using namespace std;
 
 namespace aruco
@@ -56,12 +57,117 @@ class ARUCO_EXPORTS  MarkerDetector
       (*(Marker*)this)=(*(Marker*)&M);
       contour=M.contour;
       idx=M.idx;
+      return *this;
     }
     
     vector<cv::Point> contour;//all the points of its contour
     int idx;//index position in the global contour list
   };
 public:
+  /**\brief State of the detection: the buffers employed and the results of the last call, the tracking state and the stats.
+   *
+   * The configuration of the detector is kept apart from this state, so that a single detector can be employed from several
+   * threads at once by calling the const detect functions with a different Workspace in each thread (the function set with
+   * setMakerDetectorFunction must be thread safe then, as the default one is). The buffers are reused between calls so that,
+   * once the first frames have been processed, the images and vectors of the workspace grow only when a frame needs more room
+   * (e.g., more contours or candidates). This is buffer reuse, not an allocation-free detection: the OpenCV functions employed
+   * (approxPolyDP, cornerSubPix, the fitting of lines, the pose estimation...) allocate their own temporaries, and the
+   * output markers are new objects. utils/aruco_bench_allocations reports the heap allocations done in each frame.
+   * The detect functions that do not receive a Workspace employ one internal to the detector.
+   *
+   * The members are the internal buffers of the detection and should not be modified.
+   */
+  class ARUCO_EXPORTS Workspace{
+  public:
+    Workspace():nRectangles(0),nCandidates(0),trackedArePredicted(false),nFramesSinceFullScan(0),greyIsInput(false),nReallocations(0){}
+    cv::Mat grey,thres,thres2,integralImg;
+    cv::Mat labels;//labels of the border following
+    vector<cv::Mat> pyramid;//results of the successive pyrDown
+    vector<cv::Mat> canonicalMarkers;//one per thread
+    vector<vector<cv::Point> > contours;
+    vector<cv::Vec4i> hierarchy;
+    vector<cv::Point> approxCurve;
+    vector<MarkerCandidate> rectangles;//all rectangles found in the thresholded image
+    vector<MarkerCandidate> candidates;//rectangles after removing the ones too near to each other
+    //the vectors of candidates are never shrunk: only their first elements (nRectangles, nCandidates) are valid,
+    //the rest are kept so as to reuse their memory
+    size_t nRectangles,nCandidates;
+    vector<bool> swapped,toRemove;
+    vector<pair<int,int> > tooNear;
+    //grid of the candidates employed to find these too near to each other: first candidate of each cell, next candidate in the same cell, and cell of each one
+    vector<int> gridHead,gridNext;
+    vector<cv::Point> gridCell;
+    vector<int> ids,rotations;
+    vector<char> warped;//not vector<bool>, since it is written concurrently
+    vector<int> correctedBits;
+    vector<cv::Point2f> corners;
+    //time spent on each candidate by the parallel stages (only when the stats are enabled)
+    vector<int64> warpTicks,decodeTicks,refineTicks;
+    //tracking mode: markers of the previous frame and regions where they are searched
+    vector<vector<cv::Point2f> > tracked;
+    vector<int> trackedIds;
+    vector<cv::Rect> rois;
+    //the markers tracked have been predicted (see setPredictedMarkers), so that losing them does not force a full scan
+    bool trackedArePredicted;
+    //regions of thres and thres2 written in the last call, which are cleared before thresholding only the rois
+    vector<cv::Rect> thresRois;
+    int nFramesSinceFullScan;
+    //pose tracking: poses of the markers of the previous frame, by id
+    std::map<int,SquarePoseSolver::Pose> poses;
+    //buffers of the HARRIS corner refinement (see findBestCornerInRegion_harris)
+    struct HarrisBuffers{
+      vector<int> dxx,dxy,dyy;//products of the gradients
+      vector<int> hxx,hxy,hyy;//their horizontal sums
+      vector<float> response;
+      vector<pair<float,int> > candidates;
+      vector<cv::Point> features;
+    };
+    HarrisBuffers harris;
+    //corner undistortion: camera parameters of the last call, which keep the undistortion table
+    CameraParameters undistortion;
+    bool greyIsInput;//grey is a reference to the input image, so it is not owned by the workspace
+    //number of times that a buffer of the workspace has been (re)allocated
+    size_t nReallocations;
+    //timings and counters of the detection
+    DetectionStats stats;
+    //candidates of the last call for which no valid id was found
+    vector<std::vector<cv::Point2f> > invalidCandidates;
+    /**Returns the thresholded image of the last call
+     */
+    const cv::Mat & getThresholdedImage()const{return thres;}
+    /**Returns the candidates of the last call for which no valid id was found
+     */
+    const vector<std::vector<cv::Point2f> > & getCandidates()const{return invalidCandidates;}
+    /**Returns the number of times that the buffers have been allocated or reallocated (see MarkerDetector::getNumWorkspaceReallocations)
+     */
+    size_t getNumReallocations()const{return nReallocations;}
+    /**Forgets the markers tracked, so that the next call does a full scan of the image (see MarkerDetector::setTrackingMode),
+     * and their poses (see MarkerDetector::setPoseTracking)
+     */
+    void resetTracking(){
+      tracked.clear();
+      trackedIds.clear();
+      trackedArePredicted=false;
+      poses.clear();
+      nFramesSinceFullScan=0;
+    }
+    /**Sets the markers searched in the next call to detect with this workspace in tracking mode (see MarkerDetector::setPredictedMarkers)
+     */
+    void setPredictedMarkers(const vector<Marker> &predicted);
+    //compares the buffers with these of the previous call and updates nReallocations
+    void updateReallocations();
+    //returns the element n of v, which is added if required, and increases n
+    static MarkerCandidate & next(vector<MarkerCandidate> &v,size_t &n){
+      if (n==v.size()) v.push_back(MarkerCandidate());
+      MarkerCandidate &c=v[n++];
+      c.clear();
+      c.contour.clear();
+      return c;
+    }
+  private:
+    void getState(vector<size_t> &state)const;
+    vector<size_t> _state,_prevState;
+  };
 
     /**
      * See 
@@ -95,11 +201,86 @@ public:
      * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
      */
     void detect(const cv::Mat &input,std::vector<Marker> &detectedMarkers, CameraParameters camParams,float markerSizeMeters=-1,bool setYPerperdicular=true) throw (cv::Exception);
+    /**Detects the markers in the image passed employing the workspace ws instead of the internal one (see Workspace).
+     * Since the detector is not modified, several threads can call this function at once, each one with its own workspace.
+     * The thresholded image, the candidates, the tracking state and the stats are these of the workspace.
+     * Note that setStatsEnabled only applies to the internal workspace: use ws.stats.setEnabled instead
+     *
+     * @param input input color image
+     * @param detectedMarkers output vector with the markers detected
+     * @param ws state of the detection
+     * @param camMatrix intrinsic camera information.
+     * @param distCoeff camera distorsion coefficient. If set Mat() if is assumed no camera distorion
+     * @param markerSizeMeters size of the marker sides expressed in meters
+     * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
+     */
+    void detect(const cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws,cv::Mat camMatrix=cv::Mat(),cv::Mat distCoeff=cv::Mat(),float markerSizeMeters=-1,bool setYPerperdicular=true)const throw (cv::Exception);
+    /**Detects the markers in the image passed employing the workspace ws instead of the internal one (see Workspace)
+     *
+     * @param input input color image
+     * @param detectedMarkers output vector with the markers detected
+     * @param ws state of the detection
+     * @param camParams Camera parameters
+     * @param markerSizeMeters size of the marker sides expressed in meters
+     * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
+     */
+    void detect(const cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws,CameraParameters camParams,float markerSizeMeters=-1,bool setYPerperdicular=true)const throw (cv::Exception);
+
+    /**Detects the markers in a set of images. The images are distributed dynamically among the threads indicated in setNumThreads
+     * (if the library is compiled with OpenMP), each one with its own workspace, so that the throughput grows with the number
+     * of cores. The frames are considered independent, so the tracking mode is not employed. The stats of the internal workspace are not updated.
+     *
+     * @param frames input images
+     * @param detectedMarkers output markers of each image, in the same order than frames
+     * @param camMatrix intrinsic camera information.
+     * @param distCoeff camera distorsion coefficient. If set Mat() if is assumed no camera distorion
+     * @param markerSizeMeters size of the marker sides expressed in meters
+     * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
+     */
+    void detectBatch(const std::vector<cv::Mat> &frames,std::vector<std::vector<Marker> > &detectedMarkers,cv::Mat camMatrix=cv::Mat(),cv::Mat distCoeff=cv::Mat(),float markerSizeMeters=-1,bool setYPerperdicular=true) throw (cv::Exception);
 
-    /**This set the type of thresholding methods available
+    /**Function that provides the frames to detectBatch. It must set in frame the next image and return true, or return false if there are no more images.
+     * Several frames are read before processing them, so each frame must own its data: an image whose buffer is reused for the
+     * next one (e.g., the one returned by cv::VideoCapture::read) must be cloned
      */
+    typedef bool (*FrameSource)(cv::Mat &frame,void *userData);
+    /**Function that receives the results of detectBatch: the index of the frame, the frame and its markers
+     */
+    typedef void (*MarkersCallback)(int frameIdx,const cv::Mat &frame,const std::vector<Marker> &markers,void *userData);
+    /**Streaming version of detectBatch. The frames are read from source in groups of a few frames per thread, each group is
+     * processed in parallel and then the results are passed to callback in the order of the frames. The source and the callback are
+     * always called from the calling thread
+     *
+     * @param source function that provides the frames
+     * @param callback function that receives the markers of each frame
+     * @param userData pointer passed to source and callback
+     * @param camMatrix intrinsic camera information.
+     * @param distCoeff camera distorsion coefficient. If set Mat() if is assumed no camera distorion
+     * @param markerSizeMeters size of the marker sides expressed in meters
+     * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
+     * @return number of frames processed
+     */
+    int detectBatch(FrameSource source,MarkersCallback callback,void *userData,cv::Mat camMatrix=cv::Mat(),cv::Mat distCoeff=cv::Mat(),float markerSizeMeters=-1,bool setYPerperdicular=true) throw (cv::Exception);
 
-    enum ThresholdMethods {FIXED_THRES,ADPT_THRES,CANNY};
+    /**Identifies the marker in the region of the image given by its four corners, without searching candidates. It is intended
+     * to find a marker whose position is known beforehand, e.g., projected from the pose of a board (see BoardDetector::setRedetection).
+     * The region is decoded as the candidates of detect, with the identification functions and maximum corrected bits set.
+     * Then, the corners are refined with the method set (SUBPIX if it is LINES, since there is no contour).
+     *
+     * @param grey input image (CV_8UC1)
+     * @param corners four corners of the region
+     * @param marker output marker. Its corners are these passed, sorted according to the rotation of the marker as in detect, and refined
+     * @return true if a valid marker is found
+     */
+    bool identifyMarker(const cv::Mat &grey,const std::vector<cv::Point2f> &corners,Marker &marker)const throw (cv::Exception);
+
+    /**This set the type of thresholding methods available.
+     * ADPT_THRES_INTEGRAL computes the same mean-C binarization than ADPT_THRES, but obtaining the local means from the integral image
+     * with SSE2/AVX2 kernels and processing horizontal bands of the image in parallel (see setNumThreads). Near the image borders,
+     * the mean is computed only with the pixels of the neighborhood that are into the image.
+     */
+
+    enum ThresholdMethods {FIXED_THRES,ADPT_THRES,CANNY,ADPT_THRES_INTEGRAL};
 
 
 
@@ -136,10 +317,10 @@ public:
 
 
     /**Returns a reference to the internal image thresholded. It is for visualization purposes and to adjust manually
-     * the parameters
+     * the parameters. For the detections done with a Workspace, use Workspace::getThresholdedImage
      */
     const cv::Mat & getThresholdedImage() {
-        return thres;
+        return _ws.thres;
     }
     /**Methods for corner refinement
      */
@@ -205,6 +386,25 @@ public:
      */
     void setMakerDetectorFunction(int (* markerdetector_func)(const cv::Mat &in,int &nRotations) ) {
         markerIdDetector_ptrfunc=markerdetector_func;
+        markerCellsIdDetector_ptrfunc=NULL;
+    }
+
+    /**
+     * Allows to specify a function that identifies a marker from the values of its cells instead of from its canonical image (see setMakerDetectorFunction).
+     * When set, the canonical image of the candidates is never created. Instead, the interior of each candidate is divided in nCells x nCells cells
+     * and, for each one, nSamplesPerCell x nSamplesPerCell points are projected on the image using the homography of the candidate (see sampleCells).
+     * The mean grey value of the samples of each cell is passed to the function as a CV_8UC1 matrix of nCells x nCells elements.
+     * The function must have the following structure:
+     *
+     * int myMarkerCellsIdentifier(const cv::Mat &cells,int &nRotations);
+     *
+     * and its output is the same than the one of the functions passed to setMakerDetectorFunction. For the aruco markers, use FiducidalMarkers::detectFromCells.
+     * Pass NULL to go back to the function set in setMakerDetectorFunction. It is not employed if the cylinder warp is enabled.
+     */
+    void setMarkerCellsDetectorFunction(int (* markercells_func)(const cv::Mat &cells,int &nRotations),int nCells=7,int nSamplesPerCell=3 ) {
+        markerCellsIdDetector_ptrfunc=markercells_func;
+        _nCells=nCells;
+        _nSamplesPerCell=nSamplesPerCell<1?1:nSamplesPerCell;
     }
 
     /** Use an smaller version of the input image for marker detection. 
@@ -215,6 +415,111 @@ public:
      */
     void pyrDown(unsigned int level){pyrdown_level=level;}
 
+    /**Sets the number of threads employed to identify the candidates (warping and decoding of the rectangles found).
+     * Candidates are analyzed independently and gathered afterwards in the order they were found, so the
+     * result does not depend on the number of threads. It only has effect if the library is compiled with OpenMP (ENABLE_OPENMP)
+     * @param nthreads number of threads. A value of 1 (default) performs the identification sequentially
+     */
+    void setNumThreads(int nthreads){_nThreads=nthreads<1?1:nthreads;}
+    /**Returns the number of threads employed to identify the candidates
+     */
+    int getNumThreads()const{return _nThreads;}
+
+    /**Sets the maximum number of bits that can be corrected when identifying the aruco markers (0 by default, 1 or 2).
+     * A candidate is accepted if the bits read are at that distance or less of a single marker code. The number of bits corrected
+     * is given in Marker::nCorrectedBits. Note that correcting errors increases the probability of false positives, specially with 2 bits.
+     * It only applies to the default identification functions (FiducidalMarkers::detect and FiducidalMarkers::detectFromCells)
+     */
+    void setErrorCorrectionBits(int nbits){_maxCorrectedBits=nbits<0?0:(nbits>2?2:nbits);}
+    /**Returns the maximum number of bits corrected
+     */
+    int getErrorCorrectionBits()const{return _maxCorrectedBits;}
+
+    /**Enables the tracking mode, intended for sequences in which the markers move little between consecutive frames.
+     * In this mode, the markers detected in a frame are searched in the next one only in the regions around them,
+     * so that the threshold, contour extraction and identification are not done on the whole image.
+     * A full scan of the image is done every fullScanPeriod frames (so that new markers can be found) and
+     * whenever any of the markers tracked is not found again.
+     * @param enable enables/disables the mode
+     * @param fullScanPeriod number of frames between two full scans of the image. A value of 1 is equivalent to disable the tracking
+     * @param roiScale size of the region where a marker is searched, as a factor of the size of its bounding box in the previous frame
+     */
+    void setTrackingMode(bool enable,int fullScanPeriod=10,float roiScale=2);
+    /**Indicates if the tracking mode is enabled
+     */
+    bool getTrackingMode()const{return _tracking;}
+    /**Sets the markers searched in the next call to detect in tracking mode, instead of these detected in the last one, e.g., the
+     * markers with the position expected by a PosePredictor. Unlike the markers detected, the predicted ones are optional: the
+     * predictor may keep markers that are no longer visible, so a full scan is not forced when any of them is not found, and new
+     * markers are searched every fullScanPeriod frames (see setTrackingMode). Only the corners and the ids of the markers are employed.
+     * It applies to the internal workspace: use Workspace::setPredictedMarkers with the detect functions that receive a Workspace
+     * @param predicted markers expected in the next frame
+     */
+    void setPredictedMarkers(const vector<Marker> &predicted);
+
+    /**Enables the pose tracking, intended for sequences. The pose of each marker in the previous frame is used to choose
+     * between the two solutions of the ambiguity of the pose of a square (see SquarePoseSolver), which avoids the flips of the axes
+     * of the markers seen nearly frontally. It only applies when the extrinsics are calculated in detect, and it is independent of the
+     * tracking mode (setTrackingMode)
+     * @param enable enables/disables the pose tracking
+     * @param nIterations maximum number of Gauss-Newton iterations of the refinement of the poses, which is done whether the pose tracking
+     * is enabled or not
+     */
+    void setPoseTracking(bool enable,int nIterations=3);
+    /**Indicates if the pose tracking is enabled
+     */
+    bool getPoseTracking()const{return _poseTracking;}
+
+    /**Enables the undistortion of the corners of the markers detected, as an alternative to undistort the whole image before the
+     * detection. The detection is done in the image as captured, and then the corners are taken to their position in the
+     * undistorted image (see CameraParameters::undistortPoints), so that they can be employed as if the camera had no distortion
+     * (e.g., to render with OpenGL). The extrinsics are calculated from the undistorted corners.
+     * It only applies when the camera parameters passed to detect have distortion. The undistortion table is kept in the
+     * workspace, or shared with the CameraParameters passed if its size is the one of the image. The distortion models that
+     * CameraParameters does not hold (other than 4 or 5 coefficients) are undistorted with cv::undistortPoints, without table.
+     * @param enable enables/disables the undistortion of the corners
+     */
+    void setCornerUndistortion(bool enable){_cornerUndistortion=enable;}
+    /**Indicates if the undistortion of the corners is enabled
+     */
+    bool getCornerUndistortion()const{return _cornerUndistortion;}
+
+    /**Methods for the extraction of the contours of the thresholded image
+     * OPENCV_CONTOURS: cv::findContours extracts all the contours (and their hierarchy), which are then analyzed
+     * BORDER_FOLLOWING: single pass border following that analyzes each contour as soon as it is traced. The contours out of
+     *  the size limits (see setMinMaxSize) are not stored, and only the ones that are rectangles are kept
+     */
+    enum ContourExtractionMethod {OPENCV_CONTOURS,BORDER_FOLLOWING};
+    /**Sets the method employed to extract the contours (OPENCV_CONTOURS by default)
+     */
+    void setContourExtractionMethod(ContourExtractionMethod method){_contourMethod=method;}
+    /**Returns the method employed to extract the contours
+     */
+    ContourExtractionMethod getContourExtractionMethod()const{return _contourMethod;}
+
+    /**Returns the number of times that the buffers of the internal workspace have been allocated or reallocated: its images, its
+     * vectors and the vectors of points of the contours and candidates kept (see Workspace). The buffers are reused between calls,
+     * so that this value grows only while the frames need more room than the previous ones. The temporaries of the OpenCV
+     * functions and the output markers are not accounted here (see utils/aruco_bench_allocations for all the heap allocations)
+     */
+    size_t getNumWorkspaceReallocations()const{return _ws.nReallocations;}
+
+    /**Enables/disables the measurement of the time spent in each stage of detect, and of the number of contours, rectangles,
+     * rejected candidates (by reason) and detections (see DetectionStats). When disabled (default), the cost is a few branches per call.
+     * @param enable enables/disables the measurement. The values already measured are kept
+     * @param historySize number of frames whose times are kept to obtain percentiles (see DetectionStats::getPercentile). 0 disables the history
+     */
+    void setStatsEnabled(bool enable,int historySize=0){
+        _ws.stats.setEnabled(enable);
+        if (historySize!=_ws.stats.getHistorySize()) _ws.stats.setHistorySize(historySize);
+    }
+    /**Returns the timings and counters of the detection
+     */
+    const DetectionStats & getStats()const{return _ws.stats;}
+    /**Clears the timings and counters
+     */
+    void resetStats(){_ws.stats.reset();}
+
     ///-------------------------------------------------
     /// Methods you may not need
     /// Thesde methods do the hard work. They have been set public in case you want to do customizations
@@ -230,10 +535,11 @@ public:
     */
     void detectRectangles(const cv::Mat &thresImg,vector<std::vector<cv::Point2f> > & candidates);
 
-    /**Returns a list candidates to be markers (rectangles), for which no valid id was found after calling detectRectangles
+    /**Returns a list candidates to be markers (rectangles), for which no valid id was found after calling detect.
+     * For the detections done with a Workspace, use Workspace::getCandidates
      */
     const vector<std::vector<cv::Point2f> > &getCandidates() {
-        return _candidates;
+        return _ws.invalidCandidates;
     }
 
     /**Given the iput image with markers, creates an output image with it in the canonical position
@@ -243,14 +549,43 @@ public:
      * @param points 4 corners of the marker in the image in
      * @return true if the operation succeed
      */
-    bool warp(cv::Mat &in,cv::Mat &out,cv::Size size, std::vector<cv::Point2f> points)throw (cv::Exception);
+    bool warp(cv::Mat &in,cv::Mat &out,cv::Size size, const std::vector<cv::Point2f> &points)const throw (cv::Exception);
+
+    /**Given the input image with markers, obtains the values of the cells of the marker without creating its canonical image.
+     * The marker is divided in nCells x nCells cells, and nSamplesPerCell x nSamplesPerCell points of each one are projected on the
+     * image using the homography that maps the unit square into the 4 corners.
+     * @param in input image (CV_8UC1)
+     * @param cells output CV_8UC1 matrix of nCells x nCells with the mean value of the samples of each cell
+     * @param nCells number of cells in each direction
+     * @param nSamplesPerCell number of samples of each cell in each direction
+     * @param points 4 corners of the marker in the image in
+     * @return true if the operation succeed
+     */
+    bool sampleCells(const cv::Mat &in,cv::Mat &cells,int nCells,int nSamplesPerCell,const std::vector<cv::Point2f> &points)const throw (cv::Exception);
     
     
     
     /** Refine MarkerCandidate Corner using LINES method
      * @param candidate candidate to refine corners
      */
-    void refineCandidateLines(MarkerCandidate &candidate);    
+    void refineCandidateLines(MarkerCandidate &candidate)const;    
+
+    /**Refines corners as the HARRIS method does: each corner is moved to the strongest corner point (minimum eigenvalue of the
+     * structure tensor, as cv::goodFeaturesToTrack) nearest to it in the blockSize x blockSize window around it.
+     * The gradients and the structure tensor of all the windows are computed directly on the image (with SSE2 if available),
+     * reusing the same buffers for all the corners. Near the limits of the image, its border rows and columns are replicated.
+     * @param grey input image (CV_8UC1)
+     * @param Corners corners to refine
+     * @param blockSize size of the window searched
+     */
+    void findBestCornerInRegion_harris(const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize)const;
+    /**As above, employing the buffers passed (e.g., these of a Workspace) instead of allocating them in each call
+     */
+    void findBestCornerInRegion_harris(const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize,Workspace::HarrisBuffers &buffers)const;
+    /**Previous implementation of findBestCornerInRegion_harris, that calls cv::goodFeaturesToTrack in each window.
+     * It is kept as a reference for benchmarking (see aruco_bench_harris)
+     */
+    void findBestCornerInRegion_harris_goodFeatures(const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize)const;
     
     
     /**DEPRECATED!!! Use the member function in CameraParameters
@@ -271,39 +606,74 @@ public:
 private:
 
     bool _enableCylinderWarp;
-    bool warp_cylinder ( cv::Mat &in,cv::Mat &out,cv::Size size, MarkerCandidate& mc ) throw ( cv::Exception );
+    bool warp_cylinder ( cv::Mat &in,cv::Mat &out,cv::Size size, MarkerCandidate& mc ) const throw ( cv::Exception );
     /**
     * Detection of candidates to be markers, i.e., rectangles.
-    * This function returns in candidates all the rectangles found in a thresolded image
+    * This function adds to ws.candidates all the rectangles found in the region roi (whole image if empty) of a thresolded image
     */
-    void detectRectangles(const cv::Mat &thresImg,vector<MarkerCandidate> & candidates);
+    void detectRectangles(const cv::Mat &thresImg,Workspace &ws,cv::Rect roi=cv::Rect())const;
+    //analyzes if the contour ws.contours[contourIdx] is a rectangle and adds it to ws.rectangles
+    bool addRectangle(Workspace &ws,int contourIdx)const;
+    //contour extraction by border following (BORDER_FOLLOWING)
+    void findRectanglesBorderFollowing(const cv::Mat &thresImg,Workspace &ws,cv::Rect roi,int minSize,int maxSize)const;
+    //thresholds the image and finds the candidates, either in the whole image or in the tracking rois
+    void findCandidates(const cv::Mat &img,Workspace &ws,double param1,double param2,bool fullScan)const;
+    //decodes the candidates found
+    void identifyCandidates(Workspace &ws,vector<Marker> &detectedMarkers)const;
+    //whether the identification functions set can correct errors
+    bool canCorrectErrors(bool useCells)const;
+    //obtains the id of a canonical image (or of its cells) with the identification functions set
+    int decodeCanonical(const cv::Mat &canonical,bool useCells,bool correctErrors,int &nRotations,int &correctedBits)const;
+    //tracking mode auxiliar functions
+    void getTrackingRois(Workspace &ws,cv::Size imSize,float scale)const;
+    bool isTrackLost(const Workspace &ws,const vector<Marker> &detectedMarkers)const;
     //Current threshold method
     ThresholdMethods _thresMethod;
     //Threshold parameters
     double _thresParam1,_thresParam2;
     //Current corner method
     CornerRefinementMethod _cornerMethod;
+    //Current contour extraction method
+    ContourExtractionMethod _contourMethod;
     //minimum and maximum size of a contour lenght
     float _minSize,_maxSize;
     //Speed control
     int _speed;
     int _markerWarpSize;
     bool _doErosion;
-    //vectr of candidates to be markers. This is a vector with a set of rectangles that have no valid id
-    vector<std::vector<cv::Point2f> > _candidates;
     //level of image reduction
     int pyrdown_level;
-    //Images
-    cv::Mat grey,thres,thres2,reduced;
+    //number of threads for the identification of candidates
+    int _nThreads;
+    //tracking mode
+    bool _tracking;
+    int _fullScanPeriod;
+    float _roiScale;
+    //pose tracking
+    bool _poseTracking;
+    int _poseIterations;
+    //undistortion of the corners
+    bool _cornerUndistortion;
+    //buffers reused between calls
+    Workspace _ws;
+    //workspaces of the threads of detectBatch, and the frames and results of the streaming version
+    vector<Workspace> _batchWs;
+    vector<cv::Mat> _batchFrames;
+    vector<vector<Marker> > _batchMarkers;
     //pointer to the function that analizes a rectangular region so as to detect its internal marker
     int (* markerIdDetector_ptrfunc)(const cv::Mat &in,int &nRotations);
+    //pointer to the function that analizes the cells of a marker (if NULL, markerIdDetector_ptrfunc is employed)
+    int (* markerCellsIdDetector_ptrfunc)(const cv::Mat &cells,int &nRotations);
+    int _nCells,_nSamplesPerCell;
+    //maximum number of bits corrected by the default identification functions
+    int _maxCorrectedBits;
 
     /**
      */
-    bool isInto(cv::Mat &contour,std::vector<cv::Point2f> &b);
+    bool isInto(cv::Mat &contour,std::vector<cv::Point2f> &b)const;
     /**
      */
-    int perimeter(std::vector<cv::Point2f> &a);
+    int perimeter(std::vector<cv::Point2f> &a)const;
 
     
 //     //GL routines
@@ -315,13 +685,16 @@ private:
 //                         double b1, double b2, double b3 );
 // 
 
-    //detection of the
-    void findBestCornerInRegion_harris(const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize);
+    //threshold employing the buffers of ws
+    void thresHold(int method,const cv::Mat &grey,cv::Mat &thresImg,double param1,double param2,Workspace &ws)const throw(cv::Exception);
+    //adaptive threshold using the integral image (ADPT_THRES_INTEGRAL)
+    void adaptiveThresholdIntegral(const cv::Mat &grey,cv::Mat &out,int blockSize,double C,cv::Mat &integralImg)const;
+
    
     
     // auxiliar functions to perform LINES refinement
-    void interpolate2Dline( const vector< cv::Point > &inPoints, cv::Point3f &outLine);
-    cv::Point2f getCrossPoint(const cv::Point3f& line1, const cv::Point3f& line2);      
+    void interpolate2Dline( const vector< cv::Point > &inPoints, cv::Point3f &outLine)const;
+    cv::Point2f getCrossPoint(const cv::Point3f& line1, const cv::Point3f& line2)const;      
     
     
     /**Given a vector vinout with elements and a boolean vector indicating the lements from it to remove, 
@@ -330,7 +703,7 @@ private:
      * @param toRemove
      */
     template<typename T>
-    void removeElements(vector<T> & vinout,const vector<bool> &toRemove)
+    void removeElements(vector<T> & vinout,const vector<bool> &toRemove)const
     {
        //remove the invalid ones by setting the valid in the positions left by the invalids
       size_t indexValid=0;
@@ -0,0 +1,189 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#include "multiboarddetector.h"
+#include <algorithm>
+using namespace std;
+using namespace cv;
+namespace aruco
+{
+/**
+*/
+MultiBoardDetector::MultiBoardDetector(bool setYPerperdicular)
+{
+    _setYPerperdicular=setYPerperdicular;
+    _nThreads=1;
+    _markerSize=-1;
+    _poseTracking=false;
+    _maxTrackingReprojErr=2;
+}
+/**
+*/
+int MultiBoardDetector::addBoard(const BoardConfiguration &bc)throw(cv::Exception)
+{
+    if (bc.size()==0) throw cv::Exception(8881,"MultiBoardDetector::addBoard","Invalid BoardConfig that is empty",__FILE__,__LINE__);
+    if (bc[0].size()<2) throw cv::Exception(8881,"MultiBoardDetector::addBoard","Invalid BoardConfig that is empty 2",__FILE__,__LINE__);
+    int board=_bconfs.size();
+    _bconfs.push_back(bc);
+    //the table of ids must be up to date, since the boards are searched concurrently
+    _bconfs.back().updateIdIndex();
+    _bdetectors.push_back(BoardDetector(_setYPerperdicular));
+    _bdetectors.back().setPoseTracking(_poseTracking,_maxTrackingReprojErr);
+    _boardMarkers.resize(_bconfs.size());
+    for (size_t i=0;i<bc.size();i++) {
+        IndexEntry e;
+        e.id=bc[i].id;
+        e.board=board;
+        e.marker=i;
+        _index.push_back(e);
+    }
+    std::stable_sort(_index.begin(),_index.end());
+    return board;
+}
+/**
+*/
+void MultiBoardDetector::clear()
+{
+    _bconfs.clear();
+    _bdetectors.clear();
+    _index.clear();
+    _boardMarkers.clear();
+    _boards.clear();
+    _probs.clear();
+}
+/**
+*/
+void MultiBoardDetector::getBoardsOfMarkerId(int id,vector<pair<int,int> > &boardAndIndex)const
+{
+    boardAndIndex.clear();
+    IndexEntry key;
+    key.id=id;
+    pair<vector<IndexEntry>::const_iterator,vector<IndexEntry>::const_iterator> range=std::equal_range(_index.begin(),_index.end(),key);
+    for (vector<IndexEntry>::const_iterator it=range.first;it!=range.second;++it)
+        boardAndIndex.push_back(make_pair(it->board,it->marker));
+}
+/**
+*/
+void MultiBoardDetector::setParams(const CameraParameters &cp,float markerSizeMeters)
+{
+    _camParams=cp;
+    _markerSize=markerSizeMeters;
+}
+/**
+*/
+void MultiBoardDetector::setYPerperdicular(bool enable)
+{
+    _setYPerperdicular=enable;
+    for (size_t i=0;i<_bdetectors.size();i++) _bdetectors[i].setYPerperdicular(enable);
+}
+/**
+*/
+void MultiBoardDetector::setPoseTracking(bool enable,float maxReprojErr)
+{
+    //kept for the boards added later
+    _poseTracking=enable;
+    _maxTrackingReprojErr=maxReprojErr;
+    for (size_t i=0;i<_bdetectors.size();i++) _bdetectors[i].setPoseTracking(enable,maxReprojErr);
+}
+/**
+*/
+int MultiBoardDetector::detect(const cv::Mat &im)throw(cv::Exception)
+{
+    _mdetector.detect(im,_vmarkers);
+    if (_camParams.isValid())
+        return detect(_vmarkers,_boards,_probs,_camParams.CameraMatrix,_camParams.Distorsion,_markerSize);
+    else return detect(_vmarkers,_boards,_probs);
+}
+/**
+*/
+int MultiBoardDetector::detect(const vector<Marker> &detectedMarkers,vector<Board> &boards,vector<float> &probs,const CameraParameters &cp,float markerSizeMeters)throw(cv::Exception)
+{
+    return detect(detectedMarkers,boards,probs,cp.CameraMatrix,cp.Distorsion,markerSizeMeters);
+}
+/**
+*/
+int MultiBoardDetector::detect(const vector<Marker> &detectedMarkers,vector<Board> &boards,vector<float> &probs,cv::Mat camMatrix,cv::Mat distCoeff,float markerSizeMeters)throw(cv::Exception)
+{
+    int nBoards=_bconfs.size();
+    boards.resize(nBoards);
+    probs.resize(nBoards);
+    //assign each marker to its boards in a single pass
+    for (int b=0;b<nBoards;b++) _boardMarkers[b].clear();
+    IndexEntry key;
+    for (size_t i=0;i<detectedMarkers.size();i++) {
+        key.id=detectedMarkers[i].id;
+        vector<IndexEntry>::const_iterator it=std::lower_bound(_index.begin(),_index.end(),key);
+        for (;it!=_index.end() && it->id==key.id;++it)
+            _boardMarkers[it->board].push_back(detectedMarkers[i]);
+    }
+    //each board only receives its markers, so that the detectors only calculate the poses
+    //the exceptions can not leave the parallel region. The first one is thrown afterwards, as a cv::Exception
+    bool failed=false;
+    cv::Exception error;
+#ifdef _OPENMP
+    #pragma omp parallel for num_threads(_nThreads) schedule(dynamic) if(_nThreads>1)
+#endif
+    for (int b=0;b<nBoards;b++) {
+        try {
+            probs[b]=_bdetectors[b].detect(_boardMarkers[b],_bconfs[b],boards[b],camMatrix,distCoeff,markerSizeMeters);
+        }
+        catch (cv::Exception &ex) {
+#ifdef _OPENMP
+            #pragma omp critical(aruco_multiboard_error)
+#endif
+            {
+                if (!failed) error=ex;
+                failed=true;
+            }
+        }
+        catch (std::exception &ex) {
+#ifdef _OPENMP
+            #pragma omp critical(aruco_multiboard_error)
+#endif
+            {
+                if (!failed) error=cv::Exception(8881,ex.what(),"MultiBoardDetector::detect",__FILE__,__LINE__);
+                failed=true;
+            }
+        }
+        catch (...) {
+#ifdef _OPENMP
+            #pragma omp critical(aruco_multiboard_error)
+#endif
+            {
+                if (!failed) error=cv::Exception(8881,"unknown exception","MultiBoardDetector::detect",__FILE__,__LINE__);
+                failed=true;
+            }
+        }
+    }
+    if (failed) throw error;
+    int nFound=0;
+    for (int b=0;b<nBoards;b++)
+        if (probs[b]>0) nFound++;
+    return nFound;
+}
+
+};
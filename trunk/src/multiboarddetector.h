@@ -0,0 +1,156 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#ifndef _Aruco_MultiBoardDetector_H
+#define _Aruco_MultiBoardDetector_H
+#include <opencv2/opencv.hpp>
+#include "exports.h"
+#include "board.h"
+#include "boarddetector.h"
+#include "cameraparameters.h"
+#include "markerdetector.h"
+using namespace std;
+
+namespace aruco
+{
+
+/**\brief Detects several boards in the same images
+ *
+ * The class holds a set of board configurations and an index of the ids of all their markers, so that the markers detected
+ * are assigned to their boards in a single pass. Then, the boards are detected and their poses calculated in parallel (see setNumThreads).
+ * As in BoardDetector, the markers can be detected by the class or be given:
+ * \code
+  MultiBoardDetector MBD;
+  for (size_t i=0;i<configurations.size();i++)
+    MBD.addBoard(configurations[i]);
+  MBD.setParams(CP,markerSize);
+  MBD.detect(image);
+  for (size_t i=0;i<MBD.getNumBoards();i++)
+    if (MBD.getProbabilities()[i]>0.3)
+      CvDrawingUtils::draw3dAxis(image,MBD.getDetectedBoards()[i],CP);
+ \endcode
+ */
+class ARUCO_EXPORTS MultiBoardDetector
+{
+public:
+    /**See BoardDetector::setYPerperdicular
+     */
+    MultiBoardDetector(bool setYPerperdicular=true);
+
+    /**Adds a board to detect
+     * @return index of the board, which is the index of its results in detect
+     */
+    int addBoard(const BoardConfiguration &bc)throw(cv::Exception);
+    /**Removes all the boards
+     */
+    void clear();
+    /**Returns the number of boards
+     */
+    size_t getNumBoards()const{return _bconfs.size();}
+    /**Returns the configuration of the board with the index given
+     */
+    const BoardConfiguration & getBoardConfiguration(int idx)const{return _bconfs[idx];}
+    /**Returns the boards (index of the board, index of the marker in it) that contain the id given
+     */
+    void getBoardsOfMarkerId(int id,vector<pair<int,int> > &boardAndIndex)const;
+
+    /**Use if you plan to let this class to perform marker detection too
+     */
+    void setParams(const CameraParameters &cp,float markerSizeMeters=-1);
+    /**Detects the markers, and then, the boards
+     * @return number of boards of which any marker has been detected
+     */
+    int detect(const cv::Mat &im)throw(cv::Exception);
+    /**Returns the boards detected in the last call to detect(const cv::Mat &), one per board in the order in which they were added
+     */
+    vector<Board> & getDetectedBoards(){return _boards;}
+    /**Returns the likelihood of having found each board in the last call to detect(const cv::Mat &)
+     */
+    const vector<float> & getProbabilities()const{return _probs;}
+    /**Returns a reference to the internal marker detector
+     */
+    MarkerDetector &getMarkerDetector(){return _mdetector;}
+    /**Returns the vector of markers detected in the last call to detect(const cv::Mat &)
+     */
+    vector<Marker> &getDetectedMarkers(){return _vmarkers;}
+
+    /**Given the markers detected, determines which boards are present
+     * @param detectedMarkers result provided by aruco::MarkerDetector
+     * @param boards output information of the boards, one per board in the order in which they were added
+     * @param probs likelihood of having found each board
+     * @param camMatrix intrinsic camera information.
+     * @param distCoeff camera distorsion coefficient. If set Mat() if is assumed no camera distorion
+     * @param markerSizeMeters size of the marker sides expressed in meters
+     * @return number of boards of which any marker has been detected
+     */
+    int detect(const vector<Marker> &detectedMarkers,vector<Board> &boards,vector<float> &probs,cv::Mat camMatrix=cv::Mat(),cv::Mat distCoeff=cv::Mat(),float markerSizeMeters=-1)throw(cv::Exception);
+    int detect(const vector<Marker> &detectedMarkers,vector<Board> &boards,vector<float> &probs,const CameraParameters &cp,float markerSizeMeters=-1)throw(cv::Exception);
+
+    /**Sets the number of threads among which the boards are distributed
+     */
+    void setNumThreads(int nthreads){_nThreads=nthreads<1?1:nthreads;}
+    /**Returns the number of threads
+     */
+    int getNumThreads()const{return _nThreads;}
+    /**See BoardDetector::setYPerperdicular
+     */
+    void setYPerperdicular(bool enable);
+    /**See BoardDetector::setPoseTracking. The poses are kept per board. It applies to the boards added afterwards too
+     */
+    void setPoseTracking(bool enable,float maxReprojErr=2);
+    /**
+     */
+    bool getPoseTracking()const{return _poseTracking;}
+
+private:
+    //element of the index of the ids
+    struct IndexEntry {
+        int id,board,marker;
+        bool operator<(const IndexEntry &e)const{return id<e.id;}
+    };
+    bool _setYPerperdicular;
+    bool _poseTracking;
+    float _maxTrackingReprojErr;
+    vector<BoardConfiguration> _bconfs;
+    //one detector per board, which keeps its pose tracking state and allows to detect the boards in parallel
+    vector<BoardDetector> _bdetectors;
+    //index of the ids of the markers of all the boards, sorted by id
+    vector<IndexEntry> _index;
+    //markers detected assigned to each board
+    vector<vector<Marker> > _boardMarkers;
+    int _nThreads;
+    //-- Functionality to detect markers inside
+    float _markerSize;
+    CameraParameters _camParams;
+    MarkerDetector _mdetector;
+    vector<Marker> _vmarkers;
+    vector<Board> _boards;
+    vector<float> _probs;
+};
+
+};
+#endif
@@ -0,0 +1,95 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#include "mutex.h"
+#if defined WIN32 || defined _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+namespace aruco
+{
+#if defined WIN32 || defined _WIN32
+/**
+ */
+Mutex::Mutex()
+{
+    CRITICAL_SECTION *cs=new CRITICAL_SECTION;
+    InitializeCriticalSection(cs);
+    _handle=cs;
+}
+/**
+ */
+Mutex::~Mutex()
+{
+    CRITICAL_SECTION *cs=(CRITICAL_SECTION*)_handle;
+    DeleteCriticalSection(cs);
+    delete cs;
+}
+/**
+ */
+void Mutex::lock()
+{
+    EnterCriticalSection((CRITICAL_SECTION*)_handle);
+}
+/**
+ */
+void Mutex::unlock()
+{
+    LeaveCriticalSection((CRITICAL_SECTION*)_handle);
+}
+#else
+/**
+ */
+Mutex::Mutex()
+{
+    pthread_mutex_t *m=new pthread_mutex_t;
+    pthread_mutex_init(m,NULL);
+    _handle=m;
+}
+/**
+ */
+Mutex::~Mutex()
+{
+    pthread_mutex_t *m=(pthread_mutex_t*)_handle;
+    pthread_mutex_destroy(m);
+    delete m;
+}
+/**
+ */
+void Mutex::lock()
+{
+    pthread_mutex_lock((pthread_mutex_t*)_handle);
+}
+/**
+ */
+void Mutex::unlock()
+{
+    pthread_mutex_unlock((pthread_mutex_t*)_handle);
+}
+#endif
+}
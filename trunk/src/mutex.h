@@ -0,0 +1,69 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#ifndef _Aruco_Mutex_H
+#define _Aruco_Mutex_H
+#include "exports.h"
+namespace aruco
+{
+/**\brief Mutex of the data shared by the objects of the library (e.g., the caches of CameraParameters).
+ *
+ * It is implemented with the primitives of the system (pthreads or Win32), so that it excludes every thread,
+ * not only these of OpenMP, and it does not depend on the library being compiled with OpenMP.
+ */
+class ARUCO_EXPORTS Mutex
+{
+public:
+    Mutex();
+    ~Mutex();
+    void lock();
+    void unlock();
+private:
+    //not copyable
+    Mutex(const Mutex &);
+    Mutex & operator=(const Mutex &);
+    void *_handle;
+};
+
+/**\brief Locks a Mutex during its lifetime
+ */
+class ScopedLock
+{
+public:
+    ScopedLock(Mutex &m):_mutex(m) {
+        _mutex.lock();
+    }
+    ~ScopedLock() {
+        _mutex.unlock();
+    }
+private:
+    ScopedLock(const ScopedLock &);
+    ScopedLock & operator=(const ScopedLock &);
+    Mutex &_mutex;
+};
+}
+#endif
@@ -0,0 +1,262 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#include "posepredictor.h"
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <limits>
+using namespace cv;
+using namespace std;
+namespace aruco
+{
+/**
+ *
+ */
+PosePredictor::PosePredictor(float processNoise,float measurementNoise):_kf(12,6,0)
+{
+    //state: rvec, tvec and their velocities per frame, which are constant but for the process noise
+    setIdentity(_kf.transitionMatrix);
+    for (int i=0;i<6;i++) _kf.transitionMatrix.at<float>(i,i+6)=1;
+    _kf.measurementMatrix=Mat::zeros(6,12,CV_32FC1);
+    for (int i=0;i<6;i++) _kf.measurementMatrix.at<float>(i,i)=1;
+    setNoise(processNoise,measurementNoise);
+    reset();
+}
+/**
+ *
+ */
+void PosePredictor::setNoise(float processNoise,float measurementNoise)
+{
+    _processNoise=processNoise;
+    _measurementNoise=measurementNoise;
+    //the velocity changes by a random acceleration in each frame, which also moves the pose by half of it
+    float q2=processNoise*processNoise;
+    _kf.processNoiseCov=Mat::zeros(12,12,CV_32FC1);
+    for (int i=0;i<6;i++) {
+        _kf.processNoiseCov.at<float>(i,i)=q2/4;
+        _kf.processNoiseCov.at<float>(i,i+6)=_kf.processNoiseCov.at<float>(i+6,i)=q2/2;
+        _kf.processNoiseCov.at<float>(i+6,i+6)=q2;
+    }
+    _kf.measurementNoiseCov=Mat::eye(6,6,CV_32FC1)*(measurementNoise*measurementNoise);
+}
+/**
+ *
+ */
+void PosePredictor::reset()
+{
+    _valid=false;
+    _nFramesPredicted=0;
+}
+/**
+ *
+ */
+bool PosePredictor::predict(cv::Mat &Rvec,cv::Mat &Tvec)throw(cv::Exception)
+{
+    if (!_valid) return false;
+    _kf.predict();
+    //the prediction is taken as the state, so that successive calls without correction extrapolate further
+    _kf.statePre.copyTo(_kf.statePost);
+    _kf.errorCovPre.copyTo(_kf.errorCovPost);
+    _nFramesPredicted++;
+    Rvec.create(3,1,CV_32FC1);
+    Tvec.create(3,1,CV_32FC1);
+    for (int i=0;i<3;i++) {
+        Rvec.at<float>(i,0)=_kf.statePost.at<float>(i,0);
+        Tvec.at<float>(i,0)=_kf.statePost.at<float>(i+3,0);
+    }
+    return true;
+}
+/**
+ *
+ */
+void PosePredictor::correct(cv::Mat &Rvec,cv::Mat &Tvec)throw(cv::Exception)
+{
+    if (Rvec.total()!=3 || Tvec.total()!=3) throw cv::Exception(9004,"Rvec and Tvec must have 3 elements","PosePredictor::correct",__FILE__,__LINE__);
+    Mat r,t;
+    Rvec.convertTo(r,CV_32F);
+    Tvec.convertTo(t,CV_32F);
+    Mat measurement(6,1,CV_32FC1);
+    for (int i=0;i<3;i++) {
+        measurement.at<float>(i,0)=r.ptr<float>(0)[i];
+        measurement.at<float>(i+3,0)=t.ptr<float>(0)[i];
+    }
+    if (!_valid) {
+        //the pose is the one measured, and the velocity is unknown
+        _kf.statePost=Mat::zeros(12,1,CV_32FC1);
+        Mat pose=_kf.statePost.rowRange(0,6);
+        measurement.copyTo(pose);
+        _kf.errorCovPost=Mat::eye(12,12,CV_32FC1);
+        for (int i=0;i<6;i++) _kf.errorCovPost.at<float>(i,i)=_measurementNoise*_measurementNoise;
+        _valid=true;
+    }
+    else {
+        //if predict has not been called in this frame, the state is advanced now
+        if (_nFramesPredicted==0) _kf.predict();
+        makeContinuous(_kf.statePre.ptr<float>(0),measurement.ptr<float>(0));
+        _kf.correct(measurement);
+    }
+    _nFramesPredicted=0;
+    Rvec.create(3,1,CV_32FC1);
+    Tvec.create(3,1,CV_32FC1);
+    for (int i=0;i<3;i++) {
+        Rvec.at<float>(i,0)=_kf.statePost.at<float>(i,0);
+        Tvec.at<float>(i,0)=_kf.statePost.at<float>(i+3,0);
+    }
+}
+/**
+ *
+ */
+void PosePredictor::makeContinuous(const float ref[3],float r[3])
+{
+    //the rotations of angle a, a-2pi and a+2pi around the same axis are the same one
+    double angle=sqrt(double(r[0]*r[0]+r[1]*r[1]+r[2]*r[2]));
+    if (angle<1e-6) return;
+    double bestScale=1,bestDist=std::numeric_limits<double>::max();
+    for (int k=-1;k<=1;k++) {
+        double scale=(angle+2*M_PI*k)/angle,dist=0;
+        for (int i=0;i<3;i++) dist+=(r[i]*scale-ref[i])*(r[i]*scale-ref[i]);
+        if (dist<bestDist) {
+            bestDist=dist;
+            bestScale=scale;
+        }
+    }
+    for (int i=0;i<3;i++) r[i]*=bestScale;
+}
+/**
+ *
+ */
+void PosePredictor::projectMarker(Marker &marker,const CameraParameters &cp,bool setYPerperdicular)throw(cv::Exception)
+{
+    if (marker.ssize<=0) throw cv::Exception(9004,"ssize<=0: invalid marker size","PosePredictor::projectMarker",__FILE__,__LINE__);
+    if (!cp.isValid()) throw cv::Exception(9004,"invalid camera parameters","PosePredictor::projectMarker",__FILE__,__LINE__);
+    //corners as in Marker::calculateExtrinsics, in the reference system rotated if the Y axis is perpendicular
+    float h=marker.ssize/2.;
+    const float X[4]={-h,-h,h,h};
+    const float Y[4]={-h,h,h,-h};
+    vector<Point3f> objPoints(4);
+    for (int c=0;c<4;c++)
+        objPoints[c]=setYPerperdicular?Point3f(X[c],0,-Y[c]):Point3f(X[c],Y[c],0);
+    vector<Point2f> corners;
+    projectPoints(Mat(objPoints),marker.Rvec,marker.Tvec,cp.CameraMatrix,cp.Distorsion,corners);
+    marker.resize(4);
+    for (int c=0;c<4;c++) marker[c]=corners[c];
+}
+/**
+ *
+ */
+void PosePredictor::projectBoard(Board &board,const CameraParameters &cp,float markerSizeMeters,bool setYPerperdicular)throw(cv::Exception)
+{
+    if (!cp.isValid()) throw cv::Exception(9004,"invalid camera parameters","PosePredictor::projectBoard",__FILE__,__LINE__);
+    const BoardConfiguration &conf=board.conf;
+    if (board.size()==0) return;
+    if (conf.size()==0 || conf[0].size()<2) throw cv::Exception(9004,"invalid board configuration","PosePredictor::projectBoard",__FILE__,__LINE__);
+    //corners as in BoardDetector::detect, in the reference system rotated if the Y axis is perpendicular
+    double marker_meter_per_pix=1;
+    if (conf.mInfoType==BoardConfiguration::PIX) {
+        if (markerSizeMeters<=0) throw cv::Exception(9004,"markerSizeMeters<=0: the configuration is in pixels","PosePredictor::projectBoard",__FILE__,__LINE__);
+        marker_meter_per_pix=markerSizeMeters/cv::norm(conf[0][0]-conf[0][1]);
+    }
+    vector<Point3f> objPoints;
+    vector<int> markers;
+    for (size_t i=0;i<board.size();i++) {
+        int idx=conf.getIndexOfMarkerId(board[i].id);
+        if (idx==-1) continue;
+        markers.push_back(i);
+        for (int c=0;c<4;c++) {
+            Point3f p=conf[idx][c]*marker_meter_per_pix;
+            objPoints.push_back(setYPerperdicular?Point3f(p.x,-p.z,p.y):p);
+        }
+    }
+    if (markers.size()==0) return;
+    vector<Point2f> corners;
+    projectPoints(Mat(objPoints),board.Rvec,board.Tvec,cp.CameraMatrix,cp.Distorsion,corners);
+    for (size_t m=0;m<markers.size();m++) {
+        Marker &marker=board[markers[m]];
+        marker.resize(4);
+        for (int c=0;c<4;c++) marker[c]=corners[m*4+c];
+    }
+}
+
+/**
+ *
+ */
+MarkerPosePredictor::MarkerPosePredictor(int maxFramesPredicted,bool setYPerperdicular)throw(cv::Exception)
+{
+    if (maxFramesPredicted<1) throw cv::Exception(9004,"maxFramesPredicted must be at least 1","MarkerPosePredictor::MarkerPosePredictor",__FILE__,__LINE__);
+    _maxFramesPredicted=maxFramesPredicted;
+    _setYPerperdicular=setYPerperdicular;
+    _processNoise=1e-2;
+    _measurementNoise=1e-3;
+}
+/**
+ *
+ */
+void MarkerPosePredictor::setNoise(float processNoise,float measurementNoise)
+{
+    _processNoise=processNoise;
+    _measurementNoise=measurementNoise;
+    for (std::map<int,Entry>::iterator it=_markers.begin();it!=_markers.end();++it)
+        it->second.predictor.setNoise(processNoise,measurementNoise);
+}
+/**
+ *
+ */
+void MarkerPosePredictor::predict(std::vector<Marker> &predicted,const CameraParameters &cp)throw(cv::Exception)
+{
+    predicted.clear();
+    std::map<int,Entry>::iterator it=_markers.begin();
+    while (it!=_markers.end()) {
+        Entry &e=it->second;
+        if (e.predictor.getNumFramesPredicted()>=_maxFramesPredicted) {
+            _markers.erase(it++);
+            continue;
+        }
+        predicted.push_back(e.marker);
+        Marker &m=predicted.back();
+        e.predictor.predict(m.Rvec,m.Tvec);
+        PosePredictor::projectMarker(m,cp,_setYPerperdicular);
+        ++it;
+    }
+}
+/**
+ *
+ */
+void MarkerPosePredictor::correct(std::vector<Marker> &detected)throw(cv::Exception)
+{
+    for (size_t i=0;i<detected.size();i++) {
+        Marker &m=detected[i];
+        if (m.ssize<=0 || m.Tvec.total()!=3 || m.Tvec.at<float>(0,0)==-999999) continue;
+        std::map<int,Entry>::iterator it=_markers.find(m.id);
+        if (it==_markers.end()) {
+            it=_markers.insert(std::make_pair(m.id,Entry())).first;
+            it->second.predictor.setNoise(_processNoise,_measurementNoise);
+        }
+        it->second.predictor.correct(m.Rvec,m.Tvec);
+        it->second.marker=Marker(m);
+    }
+}
+}
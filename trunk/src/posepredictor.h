@@ -0,0 +1,156 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#ifndef _Aruco_PosePredictor_H
+#define _Aruco_PosePredictor_H
+#include <opencv2/opencv.hpp>
+#include <map>
+#include "exports.h"
+#include "marker.h"
+#include "board.h"
+#include "cameraparameters.h"
+namespace aruco
+{
+/**\brief Constant velocity Kalman filter of a pose (Rvec,Tvec)
+ *
+ * The state is the pose and its velocity per frame. predict() advances the state one frame and gives the pose expected,
+ * and correct() fuses it with the pose measured, which is smoothed. In a sequence, predict is called once per frame
+ * and correct in the frames in which the pose is measured, so that a pose is available in every frame even if the
+ * detection is done at a lower rate or fails in some of them. The expected pose can also be turned into the regions where the
+ * markers are searched (see projectMarker, projectBoard and MarkerDetector::setPredictedMarkers).
+ *
+ * The rotation vectors measured are taken to the representation nearest to the state, so that the filter does not
+ * jump when the angle of rotation crosses 180 degrees.
+ */
+class ARUCO_EXPORTS PosePredictor
+{
+public:
+    /**
+     * @param processNoise standard deviation of the change of velocity between frames (radians and units of Tvec per frame)
+     * @param measurementNoise standard deviation of the poses measured (radians and units of Tvec)
+     */
+    PosePredictor(float processNoise=1e-2,float measurementNoise=1e-3);
+    /**Sets the noise of the model. See constructor
+     */
+    void setNoise(float processNoise,float measurementNoise);
+    /**Forgets the state, so that the next call to correct starts again
+     */
+    void reset();
+    /**Indicates if the filter has a state, i.e., correct has been called since the last reset
+     */
+    bool isValid()const{return _valid;}
+    /**Advances the state one frame
+     * @param Rvec,Tvec output pose expected (3x1 CV_32FC1)
+     * @return false if the filter has no state
+     */
+    bool predict(cv::Mat &Rvec,cv::Mat &Tvec)throw(cv::Exception);
+    /**Corrects the state with the pose measured in the current frame. If the filter has no state, it is initialized with it
+     * @param Rvec,Tvec input pose measured (3x1 CV_32FC1 or CV_64FC1). At output, the pose filtered (3x1 CV_32FC1)
+     */
+    void correct(cv::Mat &Rvec,cv::Mat &Tvec)throw(cv::Exception);
+    /**Number of calls to predict since the last call to correct
+     */
+    int getNumFramesPredicted()const{return _nFramesPredicted;}
+
+    /**Projects the corners of a marker with its pose (Rvec and Tvec), as calculated by Marker::calculateExtrinsics
+     * @param marker marker with its pose and size (ssize). Its corners are replaced by these projected
+     * @param cp camera parameters
+     * @param setYPerperdicular the value employed to calculate the pose
+     */
+    static void projectMarker(Marker &marker,const CameraParameters &cp,bool setYPerperdicular=true)throw(cv::Exception);
+    /**Projects the corners of the markers of a board with its pose (Rvec and Tvec), as calculated by BoardDetector::detect
+     * @param board board with its pose and configuration. The corners of its markers are replaced by these projected
+     * @param cp camera parameters
+     * @param markerSizeMeters size of the marker sides expressed in meters (only required if the configuration is in pixels)
+     * @param setYPerperdicular the value employed to calculate the pose
+     */
+    static void projectBoard(Board &board,const CameraParameters &cp,float markerSizeMeters=-1,bool setYPerperdicular=true)throw(cv::Exception);
+
+private:
+    //takes the rotation vector r to the representation nearest to ref
+    static void makeContinuous(const float ref[3],float r[3]);
+    cv::KalmanFilter _kf;
+    float _processNoise,_measurementNoise;
+    bool _valid;
+    int _nFramesPredicted;
+};
+
+/**\brief Prediction of the poses of a set of markers, with a PosePredictor per marker id
+ *
+ * \code
+ MarkerPosePredictor predictor;
+ MDetector.setTrackingMode(true);
+ for each frame {
+   predictor.predict(predicted,cp);//pose expected of the markers seen lately
+   MDetector.setPredictedMarkers(predicted);//search them around the position expected
+   if (detection is run in this frame) {
+     MDetector.detect(im,markers,cp,markerSize);
+     predictor.correct(markers);//poses smoothed
+   }
+ }
+ \endcode
+ */
+class ARUCO_EXPORTS MarkerPosePredictor
+{
+public:
+    /**
+     * @param maxFramesPredicted number of frames a marker is predicted without being detected before it is forgotten (at least 1)
+     * @param setYPerperdicular the value employed to calculate the poses of the markers
+     */
+    MarkerPosePredictor(int maxFramesPredicted=10,bool setYPerperdicular=true)throw(cv::Exception);
+    /**Sets the noise of the filters. See PosePredictor
+     */
+    void setNoise(float processNoise,float measurementNoise);
+    /**Forgets all the markers
+     */
+    void reset(){_markers.clear();}
+    /**Advances one frame the poses of the markers corrected lately, and forgets these predicted more than maxFramesPredicted frames
+     * @param predicted output markers with their pose expected and their corners projected with it
+     * @param cp camera parameters
+     */
+    void predict(std::vector<Marker> &predicted,const CameraParameters &cp)throw(cv::Exception);
+    /**Corrects the poses with the markers detected in the current frame. Their poses are replaced by the filtered ones.
+     * The markers without pose (Tvec) are ignored
+     * @param detected markers detected, with their pose
+     */
+    void correct(std::vector<Marker> &detected)throw(cv::Exception);
+    /**Number of markers whose pose is predicted
+     */
+    size_t size()const{return _markers.size();}
+
+private:
+    struct Entry {
+        PosePredictor predictor;
+        Marker marker;//last marker corrected
+    };
+    std::map<int,Entry> _markers;
+    int _maxFramesPredicted;
+    bool _setYPerperdicular;
+    float _processNoise,_measurementNoise;
+};
+}
+#endif
@@ -0,0 +1,460 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#include "scenegenerator.h"
+#include "arucofidmarkers.h"
+#include <algorithm>
+using namespace cv;
+namespace aruco
+{
+
+//rigid transform from the reference system of an object to the camera
+struct ScenePose
+{
+    double R[9],T[3];
+};
+
+//rotation of the markers facing the camera. The x axis of the markers goes from the top to the bottom
+//of their images, and the y axis from the left to the right (see Marker::calculateExtrinsics)
+static const double MarkerFacingCamera[9]={0,1,0, 1,0,0, 0,0,-1};
+//rotation of the boards facing the camera. The x axis goes from the left to the right of their images and the y axis from the top to the bottom
+static const double BoardFacingCamera[9]={1,0,0, 0,1,0, 0,0,1};
+
+/**
+ *
+ */
+static void mul33 ( const double A[9],const double B[9],double C[9] )
+{
+    for ( int i=0;i<3;i++ )
+        for ( int j=0;j<3;j++ )
+            C[i*3+j]=A[i*3]*B[j]+A[i*3+1]*B[3+j]+A[i*3+2]*B[6+j];
+}
+/**
+ *
+ */
+static void rodrigues ( double rx,double ry,double rz,double R[9] )
+{
+    Mat rvec ( 3,1,CV_64FC1 ),rmat;
+    rvec.at<double> ( 0,0 ) =rx;
+    rvec.at<double> ( 1,0 ) =ry;
+    rvec.at<double> ( 2,0 ) =rz;
+    Rodrigues ( rvec,rmat );
+    for ( int i=0;i<9;i++ ) R[i]=rmat.at<double> ( i/3,i%3 );
+}
+/**Random pose of an object whose origin projects in the pixel center at a distance z. The object is rotated around the optical axis
+ * and then tilted around an axis perpendicular to it
+ */
+static ScenePose randomPose ( RNG &rng,const double facing[9],float maxTiltDeg,Point2f center,double z,const SceneGenerator::Params &params )
+{
+    double Rz[9],Rt[9],aux[9];
+    rodrigues ( 0,0,rng.uniform ( 0.,2*CV_PI ),Rz );
+    double axis=rng.uniform ( 0.,2*CV_PI ),tilt=rng.uniform ( 0.,double ( maxTiltDeg ) ) *CV_PI/180.;
+    rodrigues ( cos ( axis ) *tilt,sin ( axis ) *tilt,0,Rt );
+    ScenePose pose;
+    mul33 ( Rz,facing,aux );
+    mul33 ( Rt,aux,pose.R );
+    pose.T[0]=z* ( center.x-params.imageSize.width/2. ) /params.focal;
+    pose.T[1]=z* ( center.y-params.imageSize.height/2. ) /params.focal;
+    pose.T[2]=z;
+    return pose;
+}
+/**Projects a point of the object. Returns false if it is behind the camera
+ */
+static bool project ( const ScenePose &pose,const Point3f &p,const SceneGenerator::Params &params,Point2f &out )
+{
+    double x=pose.R[0]*p.x+pose.R[1]*p.y+pose.R[2]*p.z+pose.T[0];
+    double y=pose.R[3]*p.x+pose.R[4]*p.y+pose.R[5]*p.z+pose.T[1];
+    double z=pose.R[6]*p.x+pose.R[7]*p.y+pose.R[8]*p.z+pose.T[2];
+    if ( z<=1e-6 ) return false;
+    out.x=params.focal*x/z+params.imageSize.width/2.;
+    out.y=params.focal*y/z+params.imageSize.height/2.;
+    return true;
+}
+/**
+ *
+ */
+static void toRvecTvec ( const ScenePose &pose,Mat &Rvec,Mat &Tvec )
+{
+    Mat R ( 3,3,CV_64FC1 ),r;
+    for ( int i=0;i<9;i++ ) R.at<double> ( i/3,i%3 ) =pose.R[i];
+    Rodrigues ( R,r );
+    r.convertTo ( Rvec,CV_32F );
+    Tvec.create ( 3,1,CV_32FC1 );
+    for ( int i=0;i<3;i++ ) Tvec.at<float> ( i,0 ) =pose.T[i];
+}
+/**Renders the texture so that its corners (the outer edges of its corner pixels) are projected in dst. The borders are antialiased.
+ * Returns the region of the image modified
+ */
+static Rect renderTexture ( Mat &image,const Mat &texture,const Point2f dst[4] )
+{
+    float minX=dst[0].x,maxX=minX,minY=dst[0].y,maxY=minY;
+    for ( int c=1;c<4;c++ )
+    {
+        minX=std::min ( minX,dst[c].x );
+        maxX=std::max ( maxX,dst[c].x );
+        minY=std::min ( minY,dst[c].y );
+        maxY=std::max ( maxY,dst[c].y );
+    }
+    Rect roi=Rect ( cvFloor ( minX )-1,cvFloor ( minY )-1,cvCeil ( maxX )-cvFloor ( minX ) +3,cvCeil ( maxY )-cvFloor ( minY ) +3 ) & Rect ( 0,0,image.cols,image.rows );
+    if ( roi.area() ==0 ) return roi;
+    //only the region covered is warped
+    Point2f src[4]={Point2f ( -0.5,-0.5 ),Point2f ( texture.cols-0.5,-0.5 ),Point2f ( texture.cols-0.5,texture.rows-0.5 ),Point2f ( -0.5,texture.rows-0.5 ) },dstRoi[4];
+    for ( int c=0;c<4;c++ ) dstRoi[c]=dst[c]-Point2f ( roi.x,roi.y );
+    Mat H=getPerspectiveTransform ( src,dstRoi ),warped,alpha;
+    warpPerspective ( texture,warped,H,roi.size(),INTER_LINEAR,BORDER_CONSTANT,Scalar ( 0 ) );
+    warpPerspective ( Mat ( texture.size(),CV_8UC1,Scalar ( 255 ) ),alpha,H,roi.size(),INTER_LINEAR,BORDER_CONSTANT,Scalar ( 0 ) );
+    Mat region=image ( roi );
+    for ( int y=0;y<roi.height;y++ )
+    {
+        uchar *o=region.ptr<uchar> ( y );
+        const uchar *w=warped.ptr<uchar> ( y ),*a=alpha.ptr<uchar> ( y );
+        for ( int x=0;x<roi.width;x++ )
+            o[x]= ( uchar ) ( ( w[x]*a[x]+o[x]* ( 255-a[x] ) +127 ) /255 );
+    }
+    return roi;
+}
+/**
+ *
+ */
+static bool overlaps ( const Rect &r,const vector<Rect> &used )
+{
+    for ( size_t i=0;i<used.size();i++ )
+        if ( ( r & used[i] ).area() >0 ) return true;
+    return false;
+}
+
+/**
+ *
+ */
+SceneGenerator::Params::Params()
+{
+    imageSize=Size ( 640,480 );
+    focal=640;
+    minMarkers=1;
+    maxMarkers=6;
+    markerSize=0.05;
+    minMarkerPixels=40;
+    maxMarkerPixels=160;
+    maxTilt=50;
+    boardProbability=0.5;
+    maxClutter=5;
+    maxOccluders=2;
+    maxOccluderSize=0.15;
+    maxGradient=0.5;
+    maxBlur=1.5;
+    noise=3;
+}
+
+/**
+ *
+ */
+SceneGenerator::SceneGenerator ( const Params &params,int seed )
+{
+    _params=params;
+    _seed=seed;
+}
+
+/**
+ *
+ */
+void SceneGenerator::addBoard ( const Mat &boardImage,const BoardConfiguration &conf ) throw ( cv::Exception )
+{
+    if ( boardImage.type() !=CV_8UC1 ) throw cv::Exception ( 9001,"the board image must be CV_8UC1","SceneGenerator::addBoard",__FILE__,__LINE__ );
+    if ( !conf.isExpressedInPixels() || conf.size() ==0 ) throw cv::Exception ( 9001,"the board configuration must be expressed in pixels","SceneGenerator::addBoard",__FILE__,__LINE__ );
+    //a white margin of half a marker
+    int margin=cvCeil ( cv::norm ( conf[0][0]-conf[0][1] ) /2 );
+    Mat padded;
+    copyMakeBorder ( boardImage,padded,margin,margin,margin,margin,BORDER_CONSTANT,Scalar ( 255 ) );
+    _boardImages.push_back ( padded );
+    _boardConfs.push_back ( conf );
+    _boardOrigins.push_back ( Point ( margin+boardImage.cols/2,margin+boardImage.rows/2 ) );
+}
+
+/**
+ *
+ */
+CameraParameters SceneGenerator::getCameraParameters() const
+{
+    Mat K=Mat::eye ( 3,3,CV_32FC1 );
+    K.at<float> ( 0,0 ) =K.at<float> ( 1,1 ) =_params.focal;
+    K.at<float> ( 0,2 ) =_params.imageSize.width/2.;
+    K.at<float> ( 1,2 ) =_params.imageSize.height/2.;
+    return CameraParameters ( K,Mat::zeros ( 4,1,CV_32FC1 ),_params.imageSize );
+}
+
+/**
+ *
+ */
+void SceneGenerator::generate ( int index,Scene &scene ) const
+{
+    const Params &P=_params;
+    //the state depends only on the seed and the index
+    RNG rng ( ( ( uint64 ) ( unsigned ) _seed<<32 ) | ( unsigned ) index );
+    scene.markers.clear();
+    scene.boards.clear();
+    scene.markerSize=P.markerSize;
+    scene.image.create ( P.imageSize,CV_8UC1 );
+    scene.image.setTo ( Scalar ( rng.uniform ( 60,200 ) ) );
+    Mat &image=scene.image;
+
+    ///background clutter
+    int nClutter=rng.uniform ( 0,P.maxClutter+1 );
+    for ( int i=0;i<nClutter;i++ )
+    {
+        Point2f pts[4];
+        Point poly[4];
+        RotatedRect ( Point2f ( rng.uniform ( 0,image.cols ),rng.uniform ( 0,image.rows ) ),
+                      Size2f ( rng.uniform ( 10.f,image.cols/3.f ),rng.uniform ( 10.f,image.cols/3.f ) ),rng.uniform ( 0.f,360.f ) ).points ( pts );
+        for ( int c=0;c<4;c++ ) poly[c]=pts[c];
+        fillConvexPoly ( image,poly,4,Scalar ( rng.uniform ( 0,256 ) ) );
+    }
+
+    //regions already employed, so that the markers and boards do not overlap
+    vector<Rect> used;
+    vector<int> usedIds;
+
+    ///board
+    if ( !_boardImages.empty() && rng.uniform ( 0.f,1.f ) <P.boardProbability )
+    {
+        int b=rng.uniform ( 0,int ( _boardImages.size() ) );
+        const Mat &texture=_boardImages[b];
+        const BoardConfiguration &conf=_boardConfs[b];
+        double metersPerPix=P.markerSize/cv::norm ( conf[0][0]-conf[0][1] );
+        //the board covers from 30% to 80% of the width of the image
+        double z=P.focal*texture.cols*metersPerPix/ ( rng.uniform ( 0.3,0.8 ) *P.imageSize.width );
+        Point2f center ( P.imageSize.width* ( 0.5+rng.uniform ( -0.2,0.2 ) ),P.imageSize.height* ( 0.5+rng.uniform ( -0.2,0.2 ) ) );
+        ScenePose pose=randomPose ( rng,BoardFacingCamera,P.maxTilt,center,z,P );
+        //corners of the image
+        Point2f dst[4];
+        Point origin=_boardOrigins[b];
+        Point3f edges[4]={Point3f ( -origin.x,-origin.y,0 ),Point3f ( texture.cols-origin.x,-origin.y,0 ),
+                          Point3f ( texture.cols-origin.x,texture.rows-origin.y,0 ),Point3f ( -origin.x,texture.rows-origin.y,0 ) };
+        bool valid=true;
+        for ( int c=0;c<4;c++ ) valid&=project ( pose,edges[c]*metersPerPix,P,dst[c] );
+        if ( valid )
+        {
+            used.push_back ( renderTexture ( image,texture,dst ) );
+            scene.boards.push_back ( SceneBoard() );
+            scene.boards.back().index=b;
+            toRvecTvec ( pose,scene.boards.back().Rvec,scene.boards.back().Tvec );
+            for ( size_t m=0;m<conf.size();m++ )
+            {
+                SceneMarker sm;
+                sm.id=conf[m].id;
+                sm.board=scene.boards.size()-1;
+                sm.corners.resize ( 4 );
+                Point3f center3d ( 0,0,0 );
+                for ( int c=0;c<4;c++ )
+                {
+                    project ( pose,conf[m][c]*metersPerPix,P,sm.corners[c] );
+                    center3d+=conf[m][c]*metersPerPix;
+                }
+                center3d*=0.25;
+                //pose of the marker in the board
+                ScenePose mpose;
+                mul33 ( pose.R,MarkerFacingCamera,mpose.R );
+                for ( int i=0;i<3;i++ )
+                    mpose.T[i]=pose.R[i*3]*center3d.x+pose.R[i*3+1]*center3d.y+pose.R[i*3+2]*center3d.z+pose.T[i];
+                toRvecTvec ( mpose,sm.Rvec,sm.Tvec );
+                scene.markers.push_back ( sm );
+                usedIds.push_back ( sm.id );
+            }
+        }
+    }
+
+    ///isolated markers
+    int nMarkers=rng.uniform ( P.minMarkers,P.maxMarkers+1 );
+    for ( int m=0;m<nMarkers;m++ )
+    {
+        int id;
+        do id=rng.uniform ( 0,1024 );
+        while ( std::find ( usedIds.begin(),usedIds.end(),id ) !=usedIds.end() );
+        float pixels=rng.uniform ( P.minMarkerPixels,P.maxMarkerPixels );
+        double z=P.focal*P.markerSize/pixels;
+        //the image of the marker has a white margin of one cell, and its cells are at least as big as in the scene
+        int cell=std::max ( 2,cvCeil ( pixels/7. ) );
+        double metersPerPix=P.markerSize/ ( 7*cell );
+        //a few attempts to place it without overlapping the others
+        for ( int attempt=0;attempt<10;attempt++ )
+        {
+            Point2f center ( rng.uniform ( pixels/2,P.imageSize.width-pixels/2 ),rng.uniform ( pixels/2,P.imageSize.height-pixels/2 ) );
+            ScenePose pose=randomPose ( rng,MarkerFacingCamera,P.maxTilt,center,z,P );
+            //the x axis goes down in the image of the marker, and the y axis to the right
+            Point2f dst[4],corners[4];
+            float e0=-4.5*cell,e1=4.5*cell,c0=-3.5*cell,c1=3.5*cell;
+            Point3f edges[4]={Point3f ( e0,e0,0 ),Point3f ( e0,e1,0 ),Point3f ( e1,e1,0 ),Point3f ( e1,e0,0 ) };
+            Point3f mcorners[4]={Point3f ( c0,c0,0 ),Point3f ( c0,c1,0 ),Point3f ( c1,c1,0 ),Point3f ( c1,c0,0 ) };
+            bool valid=true;
+            for ( int c=0;c<4;c++ )
+                valid&=project ( pose,edges[c]*metersPerPix,P,dst[c] ) && project ( pose,mcorners[c]*metersPerPix,P,corners[c] );
+            if ( !valid ) continue;
+            Rect bbox=boundingRect ( Mat ( 4,1,CV_32FC2,dst ) );
+            if ( overlaps ( bbox,used ) ) continue;
+            Mat marker=FiducidalMarkers::createMarkerImage ( id,7*cell ),texture;
+            copyMakeBorder ( marker,texture,cell,cell,cell,cell,BORDER_CONSTANT,Scalar ( 255 ) );
+            renderTexture ( image,texture,dst );
+            used.push_back ( bbox );
+            usedIds.push_back ( id );
+            SceneMarker sm;
+            sm.id=id;
+            sm.corners.assign ( corners,corners+4 );
+            toRvecTvec ( pose,sm.Rvec,sm.Tvec );
+            scene.markers.push_back ( sm );
+            break;
+        }
+    }
+
+    ///occluders, centered in the markers so that they cover part of them
+    Mat occluded ( image.size(),CV_8UC1,Scalar ( 0 ) );
+    int nOccluders=scene.markers.empty() ?0:rng.uniform ( 0,P.maxOccluders+1 );
+    for ( int i=0;i<nOccluders;i++ )
+    {
+        const SceneMarker &sm=scene.markers[rng.uniform ( 0,int ( scene.markers.size() ) )];
+        Point2f center=sm.corners[rng.uniform ( 0,4 )];
+        float maxSize=P.maxOccluderSize*image.cols;
+        Point2f pts[4];
+        Point poly[4];
+        RotatedRect ( center,Size2f ( rng.uniform ( 2.f,maxSize ),rng.uniform ( 2.f,maxSize ) ),rng.uniform ( 0.f,360.f ) ).points ( pts );
+        for ( int c=0;c<4;c++ ) poly[c]=pts[c];
+        fillConvexPoly ( image,poly,4,Scalar ( rng.uniform ( 0,256 ) ) );
+        fillConvexPoly ( occluded,poly,4,Scalar ( 255 ) );
+    }
+    //fraction of each marker not visible
+    for ( size_t m=0;m<scene.markers.size();m++ )
+    {
+        SceneMarker &sm=scene.markers[m];
+        Point poly[4];
+        for ( int c=0;c<4;c++ ) poly[c]=Point ( cvRound ( sm.corners[c].x ),cvRound ( sm.corners[c].y ) );
+        double area=fabs ( contourArea ( Mat ( sm.corners ) ) );
+        Mat mask ( image.size(),CV_8UC1,Scalar ( 0 ) );
+        fillConvexPoly ( mask,poly,4,Scalar ( 255 ) );
+        mask.setTo ( Scalar ( 0 ),occluded );
+        sm.occlusion=area>0?std::max ( 0.,1.-countNonZero ( mask ) /area ) :1;
+    }
+
+    ///lighting gradient
+    float gradient=rng.uniform ( 0.f,P.maxGradient );
+    if ( gradient>0 )
+    {
+        double dir=rng.uniform ( 0.,2*CV_PI ),gx=gradient*cos ( dir ) /image.cols,gy=gradient*sin ( dir ) /image.cols;
+        for ( int y=0;y<image.rows;y++ )
+        {
+            uchar *row=image.ptr<uchar> ( y );
+            for ( int x=0;x<image.cols;x++ )
+                row[x]=saturate_cast<uchar> ( row[x]* ( 1+gx* ( x-image.cols/2 ) +gy* ( y-image.rows/2 ) ) );
+        }
+    }
+    ///blur
+    float sigma=rng.uniform ( 0.f,P.maxBlur );
+    if ( sigma>0.1 ) GaussianBlur ( image,image,Size ( 0,0 ),sigma );
+    ///noise
+    if ( P.noise>0 )
+    {
+        Mat noise ( image.size(),CV_16SC1 ),image16;
+        rng.fill ( noise,RNG::NORMAL,Scalar::all ( 0 ),Scalar::all ( P.noise ) );
+        image.convertTo ( image16,CV_16S );
+        add ( image16,noise,image16 );
+        image16.convertTo ( image,CV_8U );
+    }
+}
+
+/**
+ *
+ */
+int Scene::getIndexOfMarkerId ( int id ) const
+{
+    for ( size_t i=0;i<markers.size();i++ )
+        if ( markers[i].id==id ) return i;
+    return -1;
+}
+
+/**
+ *
+ */
+void Scene::saveToFile ( string path ) const throw ( cv::Exception )
+{
+    cv::FileStorage fs ( path,cv::FileStorage::WRITE );
+    if ( !fs.isOpened() ) throw cv::Exception ( 9001,"could not open "+path,"Scene::saveToFile",__FILE__,__LINE__ );
+    fs<<"aruco_scene_marker_size"<<markerSize;
+    fs<<"aruco_scene_markers"<<"[";
+    for ( size_t i=0;i<markers.size();i++ )
+    {
+        fs<<"{"<<"id"<<markers[i].id<<"board"<<markers[i].board<<"occlusion"<<markers[i].occlusion;
+        fs<<"corners"<<"[:";
+        for ( size_t c=0;c<markers[i].corners.size();c++ ) fs<<markers[i].corners[c];
+        fs<<"]";
+        fs<<"Rvec"<<markers[i].Rvec<<"Tvec"<<markers[i].Tvec<<"}";
+    }
+    fs<<"]";
+    fs<<"aruco_scene_boards"<<"[";
+    for ( size_t i=0;i<boards.size();i++ )
+        fs<<"{"<<"index"<<boards[i].index<<"Rvec"<<boards[i].Rvec<<"Tvec"<<boards[i].Tvec<<"}";
+    fs<<"]";
+}
+
+/**
+ *
+ */
+void Scene::readFromFile ( string path ) throw ( cv::Exception )
+{
+    cv::FileStorage fs ( path,cv::FileStorage::READ );
+    if ( fs["aruco_scene_marker_size"].name() !="aruco_scene_marker_size" )
+        throw cv::Exception ( 81818,"Scene::readFromFile","invalid file type",__FILE__,__LINE__ );
+    fs["aruco_scene_marker_size"]>>markerSize;
+    markers.clear();
+    boards.clear();
+    cv::FileNode fmarkers=fs["aruco_scene_markers"];
+    for ( FileNodeIterator it=fmarkers.begin();it!=fmarkers.end();++it )
+    {
+        SceneMarker sm;
+        sm.id= ( int ) ( *it ) ["id"];
+        sm.board= ( int ) ( *it ) ["board"];
+        sm.occlusion= ( float ) ( *it ) ["occlusion"];
+        FileNode fcorners= ( *it ) ["corners"];
+        for ( FileNodeIterator itc=fcorners.begin();itc!=fcorners.end();++itc )
+        {
+            vector<float> coordinates;
+            ( *itc ) >>coordinates;
+            if ( coordinates.size() !=2 )
+                throw cv::Exception ( 81818,"Scene::readFromFile","invalid file type",__FILE__,__LINE__ );
+            sm.corners.push_back ( Point2f ( coordinates[0],coordinates[1] ) );
+        }
+        ( *it ) ["Rvec"]>>sm.Rvec;
+        ( *it ) ["Tvec"]>>sm.Tvec;
+        markers.push_back ( sm );
+    }
+    cv::FileNode fboards=fs["aruco_scene_boards"];
+    for ( FileNodeIterator it=fboards.begin();it!=fboards.end();++it )
+    {
+        SceneBoard sb;
+        sb.index= ( int ) ( *it ) ["index"];
+        ( *it ) ["Rvec"]>>sb.Rvec;
+        ( *it ) ["Tvec"]>>sb.Tvec;
+        boards.push_back ( sb );
+    }
+}
+};
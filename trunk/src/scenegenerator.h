@@ -0,0 +1,158 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#ifndef _Aruco_SceneGenerator_H
+#define _Aruco_SceneGenerator_H
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include "exports.h"
+#include "board.h"
+#include "cameraparameters.h"
+using namespace std;
+namespace aruco
+{
+/**\brief Ground truth of a marker in a synthetic scene
+ */
+struct ARUCO_EXPORTS SceneMarker
+{
+    SceneMarker():id(-1),occlusion(0),board(-1){}
+    int id;
+    //corners in the image in the same order than in Marker, i.e., the first one is the top left corner of the image of
+    //FiducidalMarkers::createMarkerImage. Pixel centers have integer coordinates
+    vector<cv::Point2f> corners;
+    //pose respect to the camera, as given by Marker::calculateExtrinsics with setYPerperdicular=false
+    cv::Mat Rvec,Tvec;
+    //fraction of the marker that is not visible, either because it is covered by an occluder or out of the image
+    float occlusion;
+    //index of the board it belongs to, or -1 if it is not part of a board
+    int board;
+};
+
+/**\brief Ground truth of a board in a synthetic scene
+ */
+struct ARUCO_EXPORTS SceneBoard
+{
+    //index of the board in the SceneGenerator
+    int index;
+    //pose respect to the camera, as given by BoardDetector with setYPerperdicular=false
+    cv::Mat Rvec,Tvec;
+};
+
+/**\brief Synthetic image along with its ground truth (see SceneGenerator)
+ */
+class ARUCO_EXPORTS Scene
+{
+public:
+    Scene():markerSize(-1){}
+    cv::Mat image;
+    vector<SceneMarker> markers;
+    vector<SceneBoard> boards;
+    //size of the markers in meters
+    float markerSize;
+    /**Returns the index of the marker with the id passed, or -1 if it is not in the scene
+     */
+    int getIndexOfMarkerId(int id)const;
+    /**Saves the ground truth (not the image) to a file
+     */
+    void saveToFile(string path)const throw(cv::Exception);
+    /**Reads the ground truth saved with saveToFile. The image is not read
+     */
+    void readFromFile(string path)throw(cv::Exception);
+};
+
+/**\brief Creates synthetic images of markers and boards with known ground truth
+ *
+ * Each scene has a random number of markers (and, optionally, one of the boards added) with random ids and poses, rendered
+ * with a pinhole camera without distortion (see getCameraParameters). Then, occluders, a lighting gradient, blur and noise are
+ * applied. Each scene only depends on the seed and on its index, so that the scenes are reproducible and can be created in parallel.
+ */
+class ARUCO_EXPORTS SceneGenerator
+{
+public:
+    /**Parameters of the scenes
+     */
+    struct ARUCO_EXPORTS Params
+    {
+        Params();
+        cv::Size imageSize;
+        //focal length in pixels. The principal point is the center of the image
+        float focal;
+        //range of the number of markers (not counting these of the board)
+        int minMarkers,maxMarkers;
+        //size of the markers in meters
+        float markerSize;
+        //range of the size in pixels of the sides of the markers
+        float minMarkerPixels,maxMarkerPixels;
+        //maximum angle in degrees between the optical axis and the normal of the markers and boards
+        float maxTilt;
+        //probability of a scene to have a board (if any has been added)
+        float boardProbability;
+        //number of random rectangles drawn in the background
+        int maxClutter;
+        //maximum number of occluders and their maximum size as a fraction of the image width
+        int maxOccluders;
+        float maxOccluderSize;
+        //maximum relative change of the illumination across the image
+        float maxGradient;
+        //maximum sigma of the gaussian blur
+        float maxBlur;
+        //sigma of the gaussian noise
+        float noise;
+    };
+
+    /**
+     */
+    SceneGenerator(const Params &params=Params(),int seed=0);
+    /**Adds a board that can be placed in the scenes. The configuration must be expressed in pixels of the image, with the
+     * origin in its center, as these created by FiducidalMarkers::createBoardImage and the others board functions. The board is
+     * rendered with a white margin around it
+     */
+    void addBoard(const cv::Mat &boardImage,const BoardConfiguration &conf)throw(cv::Exception);
+    /**Creates the scene with the index passed
+     */
+    void generate(int index,Scene &scene)const;
+    /**Camera parameters employed to render the scenes
+     */
+    CameraParameters getCameraParameters()const;
+    /**
+     */
+    const Params & getParams()const{return _params;}
+    /**
+     */
+    int getSeed()const{return _seed;}
+
+private:
+    Params _params;
+    int _seed;
+    //images of the boards with their margin, their configurations, and the position of the origin of each configuration in its image
+    vector<cv::Mat> _boardImages;
+    vector<BoardConfiguration> _boardConfs;
+    vector<cv::Point> _boardOrigins;
+};
+};
+#endif
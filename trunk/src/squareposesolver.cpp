@@ -0,0 +1,302 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#include "squareposesolver.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+using namespace cv;
+namespace aruco
+{
+/**
+ *
+ */
+bool SquarePoseSolver::solve(const cv::Point2f corners[4],const cv::Mat &camMatrix,float size,Pose &best,Pose &alternative)throw(cv::Exception)
+{
+    if (camMatrix.rows!=3 || camMatrix.cols!=3) throw cv::Exception(9004,"camMatrix must be 3x3","SquarePoseSolver::solve",__FILE__,__LINE__);
+    if (size<=0) throw cv::Exception(9004,"size<=0: invalid size","SquarePoseSolver::solve",__FILE__,__LINE__);
+    Mat K;
+    camMatrix.convertTo(K,CV_64F);
+    double fx=K.at<double>(0,0),fy=K.at<double>(1,1),cx=K.at<double>(0,2),cy=K.at<double>(1,2);
+    double u[4],v[4];
+    for (int i=0;i<4;i++) {
+        u[i]=(corners[i].x-cx)/fx;
+        v[i]=(corners[i].y-cy)/fy;
+    }
+    return solveNormalized(u,v,size,fx,fy,best,alternative);
+}
+/**
+ *
+ */
+bool SquarePoseSolver::solveNormalized(const double u[4],const double v[4],double size,double fx,double fy,Pose &best,Pose &alternative)
+{
+    double h=size/2.;
+    const double X[4]={-h,-h,h,h};
+    const double Y[4]={-h,h,h,-h};
+
+    //homography from the unit square (s,t) to the image, with corners (0,0),(1,0),(1,1),(0,1) (Heckbert, 1989)
+    double sx=u[0]-u[1]+u[2]-u[3],sy=v[0]-v[1]+v[2]-v[3];
+    double dx1=u[1]-u[2],dx2=u[3]-u[2],dy1=v[1]-v[2],dy2=v[3]-v[2];
+    double den=dx1*dy2-dx2*dy1;
+    if (fabs(den)<1e-15) return false;
+    double g=(sx*dy2-dx2*sy)/den,k=(dx1*sy-sx*dy1)/den;
+    double a=u[1]-u[0]+g*u[1],b=u[3]-u[0]+k*u[3],c=u[0];
+    double d=v[1]-v[0]+g*v[1],e=v[3]-v[0]+k*v[3],f=v[0];
+    //compose with the map from the marker plane to the unit square: s=(y+h)/2h, t=(x+h)/2h
+    double i2h=1./(2.*h);
+    double H[9]={b*i2h,a*i2h,(a+b)/2.+c,
+                 e*i2h,d*i2h,(d+e)/2.+f,
+                 k*i2h,g*i2h,(g+k)/2.+1};
+    if (fabs(H[8])<1e-15) return false;
+    for (int i=0;i<9;i++) H[i]/=H[8];
+
+    //projection of the center of the square and jacobian of the homography at it
+    double v0=H[2],v1=H[5];
+    double j00=H[0]-H[6]*v0,j01=H[1]-H[7]*v0;
+    double j10=H[3]-H[6]*v1,j11=H[4]-H[7]*v1;
+
+    //rotation Rv that takes the z axis onto the ray of the center
+    double Rv[9]={1,0,0,0,1,0,0,0,1};
+    double nv=sqrt(v0*v0+v1*v1);
+    if (nv>1e-15) {
+        double p=v0/nv,q=v1/nv;
+        double s=sqrt(nv*nv+1.);
+        double cost=1./s,sint=nv/s,c1=1.-cost;
+        Rv[0]=1.-c1*p*p; Rv[1]=-c1*p*q;    Rv[2]=sint*p;
+        Rv[3]=-c1*p*q;   Rv[4]=1.-c1*q*q;  Rv[5]=sint*q;
+        Rv[6]=-sint*p;   Rv[7]=-sint*q;    Rv[8]=cost;
+    }
+    //A=B^-1 J, with B=[I|-v] Rv(:,0:1)
+    double b00=Rv[0]-v0*Rv[6],b01=Rv[1]-v0*Rv[7];
+    double b10=Rv[3]-v1*Rv[6],b11=Rv[4]-v1*Rv[7];
+    double dt=b00*b11-b01*b10;
+    if (fabs(dt)<1e-15) return false;
+    double a00=( b11*j00-b01*j10)/dt,a01=( b11*j01-b01*j11)/dt;
+    double a10=(-b10*j00+b00*j10)/dt,a11=(-b10*j01+b00*j11)/dt;
+    //largest singular value of A
+    double aat00=a00*a00+a01*a01,aat01=a00*a10+a01*a11,aat11=a10*a10+a11*a11;
+    double gamma=sqrt(0.5*(aat00+aat11+sqrt((aat00-aat11)*(aat00-aat11)+4.*aat01*aat01)));
+    if (gamma<1e-15) return false;
+    //upper 2x2 block of the rotation, and the two ways of completing it
+    double r00=a00/gamma,r01=a01/gamma,r10=a10/gamma,r11=a11/gamma;
+    double h00=1.-r00*r00-r10*r10,h11=1.-r01*r01-r11*r11,h01=-r00*r01-r10*r11;
+    double bb0=sqrt(std::max(h00,0.)),bb1=sqrt(std::max(h11,0.));
+    if (h01<0) bb1=-bb1;
+    double c0=r10*bb1-bb0*r11,c1=bb0*r01-r00*bb1,c2=r00*r11-r10*r01;
+
+    Pose sol[2];
+    for (int s=0;s<2;s++) {
+        double sg=(s==0?1.:-1.);
+        double M[9]={r00,r01,sg*c0,
+                     r10,r11,sg*c1,
+                     sg*bb0,sg*bb1,c2};
+        for (int i=0;i<3;i++)
+            for (int j=0;j<3;j++)
+                sol[s].R[i*3+j]=Rv[i*3]*M[j]+Rv[i*3+1]*M[3+j]+Rv[i*3+2]*M[6+j];
+        translation(sol[s].R,u,v,X,Y,sol[s].t);
+        sol[s].reprojErr=reprojectionError(sol[s],u,v,X,Y,fx,fy);
+    }
+    int ib=(sol[1].reprojErr<sol[0].reprojErr?1:0);
+    best=sol[ib];
+    alternative=sol[1-ib];
+    //nearly degenerated corners may give a solution that is not finite, or with the square behind the camera
+    if (cvIsNaN(best.reprojErr) || cvIsInf(best.reprojErr) || best.t[2]<=0) return false;
+    return true;
+}
+/**Solves the 6x6 symmetric positive definite system A*x=b, overwriting A with its Cholesky factor
+ */
+static bool solveCholesky6(double A[36],const double b[6],double x[6])
+{
+    for (int j=0;j<6;j++) {
+        double d=A[j*6+j];
+        for (int k=0;k<j;k++) d-=A[j*6+k]*A[j*6+k];
+        if (d<=1e-30) return false;
+        d=sqrt(d);
+        A[j*6+j]=d;
+        for (int i=j+1;i<6;i++) {
+            double s=A[i*6+j];
+            for (int k=0;k<j;k++) s-=A[i*6+k]*A[j*6+k];
+            A[i*6+j]=s/d;
+        }
+    }
+    //forward and back substitution
+    for (int i=0;i<6;i++) {
+        double s=b[i];
+        for (int k=0;k<i;k++) s-=A[i*6+k]*x[k];
+        x[i]=s/A[i*6+i];
+    }
+    for (int i=5;i>=0;i--) {
+        double s=x[i];
+        for (int k=i+1;k<6;k++) s-=A[k*6+i]*x[k];
+        x[i]=s/A[i*6+i];
+    }
+    return true;
+}
+/**
+ *
+ */
+const double SquarePoseSolver::maxAmbiguityError=2;
+/**
+ *
+ */
+bool SquarePoseSolver::solveNormalized(const double u[4],const double v[4],double size,double fx,double fy,const Pose &previous,Pose &pose,int nIterations)
+{
+    Pose best,alternative;
+    if (!solveNormalized(u,v,size,fx,fy,best,alternative)) return false;
+    //the nearest rotation is the one with the largest trace of previous^T*R
+    double trBest=0,trAlt=0;
+    for (int i=0;i<9;i++) {
+        trBest+=previous.R[i]*best.R[i];
+        trAlt+=previous.R[i]*alternative.R[i];
+    }
+    if (trAlt>trBest && alternative.reprojErr<=std::max(maxAmbiguityError,2*best.reprojErr)) pose=alternative;
+    else pose=best;
+    refine(u,v,size,fx,fy,pose,nIterations);
+    return true;
+}
+/**
+ *
+ */
+double SquarePoseSolver::refine(const double u[4],const double v[4],double size,double fx,double fy,Pose &pose,int nIterations)
+{
+    double h=size/2.;
+    const double X[4]={-h,-h,h,h};
+    const double Y[4]={-h,h,h,-h};
+    pose.reprojErr=reprojectionError(pose,u,v,X,Y,fx,fy);
+    for (int it=0;it<nIterations;it++) {
+        //normal equations of the residuals in pixels, with the update R=exp([w]x)*R and t=t+dt
+        double JtJ[36]={0},Jtr[6]={0};
+        for (int i=0;i<4;i++) {
+            const double *R=pose.R;
+            double a[3]={R[0]*X[i]+R[1]*Y[i],R[3]*X[i]+R[4]*Y[i],R[6]*X[i]+R[7]*Y[i]};
+            double q[3]={a[0]+pose.t[0],a[1]+pose.t[1],a[2]+pose.t[2]};
+            if (q[2]<=0) return pose.reprojErr;
+            double iz=1./q[2];
+            double r[2]={fx*(q[0]*iz-u[i]),fy*(q[1]*iz-v[i])};
+            //derivatives of the projection respect to q
+            double dp[2][3]={{fx*iz,0,-fx*q[0]*iz*iz},{0,fy*iz,-fy*q[1]*iz*iz}};
+            for (int k=0;k<2;k++) {
+                //dq/dw=-[a]x, dq/dt=I
+                double J[6]={dp[k][1]*(-a[2])+dp[k][2]*a[1],
+                             dp[k][0]*a[2]+dp[k][2]*(-a[0]),
+                             dp[k][0]*(-a[1])+dp[k][1]*a[0],
+                             dp[k][0],dp[k][1],dp[k][2]};
+                for (int m=0;m<6;m++) {
+                    Jtr[m]+=J[m]*r[k];
+                    for (int n=m;n<6;n++) JtJ[m*6+n]+=J[m]*J[n];
+                }
+            }
+        }
+        for (int m=0;m<6;m++)
+            for (int n=0;n<m;n++) JtJ[m*6+n]=JtJ[n*6+m];
+        double delta[6];
+        if (!solveCholesky6(JtJ,Jtr,delta)) break;
+        //apply the update: exp([-x]x) by Rodrigues' formula
+        Pose updated=pose;
+        double w[3]={-delta[0],-delta[1],-delta[2]};
+        double theta=sqrt(w[0]*w[0]+w[1]*w[1]+w[2]*w[2]);
+        double E[9]={1,0,0,0,1,0,0,0,1};
+        if (theta>1e-15) {
+            double k[3]={w[0]/theta,w[1]/theta,w[2]/theta};
+            double st=sin(theta),ct=1-cos(theta);
+            double K[9]={0,-k[2],k[1],k[2],0,-k[0],-k[1],k[0],0};
+            for (int m=0;m<3;m++)
+                for (int n=0;n<3;n++) {
+                    double K2=K[m*3]*K[n]+K[m*3+1]*K[3+n]+K[m*3+2]*K[6+n];
+                    E[m*3+n]+=st*K[m*3+n]+ct*K2;
+                }
+        }
+        for (int m=0;m<3;m++)
+            for (int n=0;n<3;n++)
+                updated.R[m*3+n]=E[m*3]*pose.R[n]+E[m*3+1]*pose.R[3+n]+E[m*3+2]*pose.R[6+n];
+        for (int m=0;m<3;m++) updated.t[m]=pose.t[m]-delta[3+m];
+        updated.reprojErr=reprojectionError(updated,u,v,X,Y,fx,fy);
+        if (updated.reprojErr>=pose.reprojErr) break;
+        pose=updated;
+        if (theta<1e-10) break;
+    }
+    return pose.reprojErr;
+}
+/**Least squares translation for a given rotation, minimizing the algebraic error of the projection of the corners
+ */
+void SquarePoseSolver::translation(const double R[9],const double u[4],const double v[4],const double X[4],const double Y[4],double t[3])
+{
+    //each corner gives tx-u*tz=u*pz-px and ty-v*tz=v*pz-py, with p=R*(X,Y,0). The normal equations are solved in closed form
+    double su=0,sv=0,suv=0,srx=0,sry=0,b3=0;
+    for (int i=0;i<4;i++) {
+        double px=R[0]*X[i]+R[1]*Y[i];
+        double py=R[3]*X[i]+R[4]*Y[i];
+        double pz=R[6]*X[i]+R[7]*Y[i];
+        double rx=u[i]*pz-px,ry=v[i]*pz-py;
+        su+=u[i];
+        sv+=v[i];
+        suv+=u[i]*u[i]+v[i]*v[i];
+        srx+=rx;
+        sry+=ry;
+        b3-=u[i]*rx+v[i]*ry;
+    }
+    double den=suv-(su*su+sv*sv)/4.;
+    t[2]=den>1e-30?(b3+(su*srx+sv*sry)/4.)/den:0;
+    t[0]=(srx+su*t[2])/4.;
+    t[1]=(sry+sv*t[2])/4.;
+}
+/**
+ *
+ */
+double SquarePoseSolver::reprojectionError(const Pose &pose,const double u[4],const double v[4],const double X[4],const double Y[4],double fx,double fy)
+{
+    const double *R=pose.R,*t=pose.t;
+    double err=0;
+    for (int i=0;i<4;i++) {
+        double qx=R[0]*X[i]+R[1]*Y[i]+t[0];
+        double qy=R[3]*X[i]+R[4]*Y[i]+t[1];
+        double qz=R[6]*X[i]+R[7]*Y[i]+t[2];
+        if (qz<=0) return std::numeric_limits<double>::max();
+        double du=fx*(qx/qz-u[i]),dv=fy*(qy/qz-v[i]);
+        err+=du*du+dv*dv;
+    }
+    return sqrt(err/4.);
+}
+/**
+ *
+ */
+void SquarePoseSolver::toRvecTvec(const Pose &pose,cv::Mat &Rvec,cv::Mat &Tvec,bool setYPerperdicular)
+{
+    double R[9];
+    for (int i=0;i<3;i++) {
+        R[i*3]=pose.R[i*3];
+        //R*RX, with RX a rotation of 90 degrees around X (see Marker::rotateXAxis)
+        R[i*3+1]=setYPerperdicular?pose.R[i*3+2]:pose.R[i*3+1];
+        R[i*3+2]=setYPerperdicular?-pose.R[i*3+1]:pose.R[i*3+2];
+    }
+    Mat Rm(3,3,CV_64F,R),rv;
+    Rodrigues(Rm,rv);
+    rv.convertTo(Rvec,CV_32F);
+    Tvec.create(3,1,CV_32F);
+    for (int i=0;i<3;i++) Tvec.at<float>(i,0)=pose.t[i];
+}
+}
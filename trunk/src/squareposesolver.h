@@ -0,0 +1,116 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+#ifndef _Aruco_SquarePoseSolver_H
+#define _Aruco_SquarePoseSolver_H
+#include <opencv2/opencv.hpp>
+#include "exports.h"
+namespace aruco
+{
+/**\brief Closed-form pose of a square from its four corners
+ *
+ * Implements the Infinitesimal Plane-based Pose Estimation (IPPE) of Collins and Bartoli (2014) for the corners of a
+ * square marker. The homography between the square and the image is obtained analytically, and the two poses
+ * that explain it are derived from its jacobian at the center of the square. A plane seen in perspective has
+ * in general these two solutions (the flip ambiguity); both are returned, sorted by their reprojection error.
+ *
+ * The object points follow the convention of Marker::calculateExtrinsics: corner i of a square of side s is
+ * (-s/2,-s/2,0), (-s/2,s/2,0), (s/2,s/2,0) and (s/2,-s/2,0) for i=0..3.
+ *
+ * The corners must be free of distortion, i.e., either the distortion of the camera is zero or
+ * the points have been undistorted.
+ */
+class ARUCO_EXPORTS SquarePoseSolver
+{
+public:
+    /**A solution: rotation matrix (row major), translation, and root mean square reprojection error in pixels
+     */
+    struct Pose {
+        double R[9];
+        double t[3];
+        double reprojErr;
+    };
+
+    /**Solves the pose of the square
+     * @param corners the four corners in pixels
+     * @param camMatrix 3x3 camera matrix (CV_32F or CV_64F)
+     * @param size side of the square
+     * @param best solution with the lowest reprojection error
+     * @param alternative the other solution
+     * @return false if the corners are degenerated and there is no solution
+     */
+    static bool solve(const cv::Point2f corners[4],const cv::Mat &camMatrix,float size,Pose &best,Pose &alternative)throw(cv::Exception);
+
+    /**Solves the pose of the square from the corners in normalized coordinates, i.e., ((x-cx)/fx,(y-cy)/fy)
+     * @param u,v normalized coordinates of the four corners
+     * @param size side of the square
+     * @param fx,fy focal lengths, only used to express the reprojection error in pixels
+     * @param best solution with the lowest reprojection error
+     * @param alternative the other solution
+     * @return false if the corners are degenerated and there is no solution, or if the best one is not finite or places the square behind the camera
+     */
+    static bool solveNormalized(const double u[4],const double v[4],double size,double fx,double fy,Pose &best,Pose &alternative);
+
+    /**Solves the pose of the square in a sequence, given its pose in the previous frame. Of the two solutions, the one
+     * nearest to the previous pose is taken, unless its reprojection error is clearly larger than the one of the other
+     * (see maxAmbiguityError), so that the pose does not flip between them along the sequence. The solution is then refined with refine().
+     * @param u,v normalized coordinates of the four corners
+     * @param size side of the square
+     * @param fx,fy focal lengths
+     * @param previous pose in the previous frame
+     * @param pose output pose
+     * @param nIterations maximum number of Gauss-Newton iterations of the refinement
+     * @return false if the corners are degenerated and there is no solution
+     */
+    static bool solveNormalized(const double u[4],const double v[4],double size,double fx,double fy,const Pose &previous,Pose &pose,int nIterations=3);
+
+    /**Refines a pose with Gauss-Newton iterations that minimize the reprojection error of the corners, and updates its reprojErr.
+     * An iteration that does not decrease the error is discarded and stops the refinement
+     * @param u,v normalized coordinates of the four corners
+     * @param size side of the square
+     * @param fx,fy focal lengths
+     * @param pose initial pose, refined on output
+     * @param nIterations maximum number of iterations
+     * @return the reprojection error of the refined pose
+     */
+    static double refine(const double u[4],const double v[4],double size,double fx,double fy,Pose &pose,int nIterations=3);
+
+    /**Maximum reprojection error (in pixels) of the solution nearest to the previous pose for it to be taken, if above the error of the best solution
+     */
+    static const double maxAmbiguityError;
+
+    /**Converts a solution into the rotation (Rodrigues) and translation vectors used by Marker, as CV_32F 3x1 matrices
+     * @param setYPerperdicular if set, the axes are rotated 90 degrees around X as in Marker::calculateExtrinsics, so that the Y axis is perpendicular to the square
+     */
+    static void toRvecTvec(const Pose &pose,cv::Mat &Rvec,cv::Mat &Tvec,bool setYPerperdicular=false);
+
+private:
+    static void translation(const double R[9],const double u[4],const double v[4],const double X[4],const double Y[4],double t[3]);
+    static double reprojectionError(const Pose &pose,const double u[4],const double v[4],const double X[4],const double Y[4],double fx,double fy);
+};
+}
+#endif
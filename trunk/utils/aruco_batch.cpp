@@ -0,0 +1,92 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+/************************************
+ *
+ * Offline detection of the markers of a video with MarkerDetector::detectBatch. The frames are processed in parallel
+ * and the markers of each frame are written in order (one line per marker: frame id x0 y0 x1 y1 x2 y2 x3 y3)
+ *
+ ************************************/
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include "aruco.h"
+using namespace cv;
+using namespace aruco;
+
+//the frames must own their data (see MarkerDetector::FrameSource). VideoCapture returns its internal buffer, which is
+//overwritten by the next frame read, so it is cloned
+bool readFrame(Mat &frame,void *userData)
+{
+    VideoCapture *vreader=(VideoCapture*)userData;
+    Mat image;
+    if (!vreader->read(image)) return false;
+    frame=image.clone();
+    return true;
+}
+
+ostream *TheOutput=&cout;
+void writeMarkers(int frameIdx,const Mat &frame,const vector<Marker> &markers,void *userData)
+{
+    for (size_t i=0;i<markers.size();i++) {
+        (*TheOutput)<<frameIdx<<" "<<markers[i].id;
+        for (int c=0;c<4;c++) (*TheOutput)<<" "<<markers[i][c].x<<" "<<markers[i][c].y;
+        (*TheOutput)<<endl;
+    }
+}
+
+int main(int argc,char **argv)
+{
+    try
+    {
+        if (argc<2) {
+            cerr<<"Usage: in.avi [nThreads=1] [out.txt]"<<endl;
+            return 0;
+        }
+        VideoCapture vreader(argv[1]);
+        if (!vreader.isOpened()) {
+            cerr<<"Could not open "<<argv[1]<<endl;
+            return -1;
+        }
+        MarkerDetector MDetector;
+        if (argc>=3) MDetector.setNumThreads(atoi(argv[2]));
+        ofstream file;
+        if (argc>=4) {
+            file.open(argv[3]);
+            TheOutput=&file;
+        }
+
+        double tick=(double)getTickCount();
+        int nFrames=MDetector.detectBatch(readFrame,writeMarkers,&vreader);
+        double secs=((double)getTickCount()-tick)/getTickFrequency();
+        cerr<<nFrames<<" frames in "<<secs<<" s ("<<nFrames/secs<<" fps) with "<<MDetector.getNumThreads()<<" threads"<<endl;
+    } catch (std::exception &ex)
+    {
+        cout<<"Exception :"<<ex.what()<<endl;
+    }
+}
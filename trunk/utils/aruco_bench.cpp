@@ -0,0 +1,308 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+/************************************
+ *
+ * Headless benchmark of the marker detection. The frames of the videos passed (testsdata/single/video.avi and
+ * testsdata/chessboard/chessboard.avi by default) and a set of synthetic scenes are processed with every combination of
+ * threshold method, corner refinement method, pyrDown level, size of the canonical marker image (56 or 28 pixels, the
+ * settings of setDesiredSpeed) and erosion. For each combination it reports the fps, the percentiles of the time of each
+ * stage of the detection (see DetectionStats) and the counters of candidates and detections. The synthetic scenes are
+ * created with SceneGenerator, so that the accuracy is reported too: the fraction of the fully visible markers detected,
+ * the number of false positives and the mean error of the corners (-1 for the videos).
+ * The results are written as JSON, or as CSV if the output file has the extension .csv, so that the results of two versions
+ * of the library can be compared.
+ *
+ ************************************/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include "aruco.h"
+#include "scenegenerator.h"
+using namespace cv;
+using namespace aruco;
+
+struct Dataset
+{
+    string name;
+    vector<Mat> frames;
+    //ground truth of the synthetic scenes (empty for the videos)
+    vector<Scene> truth;
+};
+
+struct Result
+{
+    string dataset;
+    int thresMethod,cornerMethod,pyrDownLevel,warpSize;
+    bool erosion;
+    int nFrames;
+    double fps;
+    double percentiles[DetectionStats::NSTAGES][3];
+    double counts[DetectionStats::NCOUNTERS];
+    //accuracy (only with ground truth)
+    double recall,cornerError;
+    int falsePositives;
+};
+
+const double ThePercentiles[3]={50,90,99};
+const char *ThresMethodNames[4]={"FIXED_THRES","ADPT_THRES","CANNY","ADPT_THRES_INTEGRAL"};
+const char *CornerMethodNames[4]={"NONE","HARRIS","SUBPIX","LINES"};
+
+/************************************
+ *
+ * Reads up to maxFrames frames of a video
+ *
+ *
+ ************************************/
+bool readVideo ( string path,int maxFrames,Dataset &ds )
+{
+    VideoCapture vreader ( path );
+    if ( !vreader.isOpened() ) return false;
+    ds.name=path;
+    Mat frame;
+    while ( int ( ds.frames.size() ) <maxFrames && vreader.grab() )
+    {
+        vreader.retrieve ( frame );
+        ds.frames.push_back ( frame.clone() );
+    }
+    return !ds.frames.empty();
+}
+
+/************************************
+ *
+ * Creates nFrames synthetic scenes with their ground truth
+ *
+ *
+ ************************************/
+void createSyntheticScenes ( int nFrames,int seed,Dataset &ds )
+{
+    SceneGenerator Generator ( SceneGenerator::Params(),seed );
+    ds.name="synthetic";
+    ds.truth.resize ( nFrames );
+    for ( int f=0;f<nFrames;f++ )
+    {
+        Generator.generate ( f,ds.truth[f] );
+        ds.frames.push_back ( ds.truth[f].image );
+    }
+}
+
+/************************************
+ *
+ * Runs the detector configured on all the frames of the dataset
+ *
+ *
+ ************************************/
+Result run ( const Dataset &ds,int thresMethod,int cornerMethod,int pyrDownLevel,int warpSize,bool erosion )
+{
+    MarkerDetector MDetector;
+    //the warp size is only set through the desired speed (0: 56 pixels, 1: 28 pixels), which changes the erosion and the
+    //corner method too, so it is set first
+    MDetector.setDesiredSpeed ( warpSize==56?0:1 );
+    MDetector.enableErosion ( erosion );
+    MDetector.setThresholdMethod ( MarkerDetector::ThresholdMethods ( thresMethod ) );
+    MDetector.setCornerRefinementMethod ( MarkerDetector::CornerRefinementMethod ( cornerMethod ) );
+    MDetector.pyrDown ( pyrDownLevel );
+    MDetector.setStatsEnabled ( true,ds.frames.size() );
+    vector<Marker> markers;
+    double secs=0,cornerError=0;
+    int nVisible=0,nFound=0,nFalse=0;
+    for ( size_t i=0;i<ds.frames.size();i++ )
+    {
+        double tick= ( double ) getTickCount();
+        MDetector.detect ( ds.frames[i],markers );
+        secs+= ( ( double ) getTickCount()-tick ) /getTickFrequency();
+        if ( ds.truth.empty() ) continue;
+        //compare with the ground truth
+        const Scene &truth=ds.truth[i];
+        for ( size_t m=0;m<truth.markers.size();m++ )
+            if ( truth.markers[m].occlusion<0.01 ) nVisible++;
+        for ( size_t m=0;m<markers.size();m++ )
+        {
+            int idx=truth.getIndexOfMarkerId ( markers[m].id );
+            if ( idx==-1 )
+            {
+                nFalse++;
+                continue;
+            }
+            const SceneMarker &sm=truth.markers[idx];
+            if ( sm.occlusion>=0.01 ) continue;
+            nFound++;
+            for ( int c=0;c<4;c++ ) cornerError+=cv::norm ( markers[m][c]-sm.corners[c] ) /4;
+        }
+    }
+
+    Result res;
+    res.dataset=ds.name;
+    res.thresMethod=thresMethod;
+    res.cornerMethod=cornerMethod;
+    res.pyrDownLevel=pyrDownLevel;
+    res.warpSize=warpSize;
+    res.erosion=erosion;
+    res.nFrames=ds.frames.size();
+    res.fps=secs>0?res.nFrames/secs:0;
+    const DetectionStats &stats=MDetector.getStats();
+    for ( int s=0;s<DetectionStats::NSTAGES;s++ )
+        for ( int p=0;p<3;p++ )
+            res.percentiles[s][p]=stats.getPercentile ( DetectionStats::Stage ( s ),ThePercentiles[p] );
+    for ( int c=0;c<DetectionStats::NCOUNTERS;c++ )
+        res.counts[c]=stats.getTotalCount ( DetectionStats::Counter ( c ) );
+    res.recall=nVisible>0?double ( nFound ) /nVisible:-1;
+    res.cornerError=nFound>0?cornerError/nFound:-1;
+    res.falsePositives=ds.truth.empty() ?-1:nFalse;
+    return res;
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void writeCSV ( ostream &out,const vector<Result> &results )
+{
+    out<<"dataset,threshold,corner,pyrdown,warp_size,erosion,frames,fps";
+    for ( int s=0;s<DetectionStats::NSTAGES;s++ )
+        for ( int p=0;p<3;p++ )
+            out<<","<<DetectionStats::getStageName ( DetectionStats::Stage ( s ) ) <<"_p"<<ThePercentiles[p];
+    for ( int c=0;c<DetectionStats::NCOUNTERS;c++ )
+        out<<","<<DetectionStats::getCounterName ( DetectionStats::Counter ( c ) );
+    out<<",recall,false_positives,corner_error"<<endl;
+    for ( size_t i=0;i<results.size();i++ )
+    {
+        const Result &r=results[i];
+        out<<r.dataset<<","<<ThresMethodNames[r.thresMethod]<<","<<CornerMethodNames[r.cornerMethod]<<","<<r.pyrDownLevel<<","<<r.warpSize<<","<<r.erosion<<","<<r.nFrames<<","<<r.fps;
+        for ( int s=0;s<DetectionStats::NSTAGES;s++ )
+            for ( int p=0;p<3;p++ )
+                out<<","<<r.percentiles[s][p];
+        for ( int c=0;c<DetectionStats::NCOUNTERS;c++ )
+            out<<","<<r.counts[c];
+        out<<","<<r.recall<<","<<r.falsePositives<<","<<r.cornerError<<endl;
+    }
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void writeJSON ( ostream &out,const vector<Result> &results )
+{
+    out<<"["<<endl;
+    for ( size_t i=0;i<results.size();i++ )
+    {
+        const Result &r=results[i];
+        out<<"  {\"dataset\": \""<<r.dataset<<"\", \"threshold\": \""<<ThresMethodNames[r.thresMethod]<<"\", \"corner\": \""<<CornerMethodNames[r.cornerMethod]
+           <<"\", \"pyrdown\": "<<r.pyrDownLevel<<", \"warp_size\": "<<r.warpSize<<", \"erosion\": "<< ( r.erosion?"true":"false" ) <<", \"frames\": "<<r.nFrames<<", \"fps\": "<<r.fps<<","<<endl;
+        out<<"   \"latency_ms\": {";
+        for ( int s=0;s<DetectionStats::NSTAGES;s++ )
+        {
+            out<< ( s==0?"":", " ) <<"\""<<DetectionStats::getStageName ( DetectionStats::Stage ( s ) ) <<"\": {";
+            for ( int p=0;p<3;p++ )
+                out<< ( p==0?"":", " ) <<"\"p"<<ThePercentiles[p]<<"\": "<<r.percentiles[s][p];
+            out<<"}";
+        }
+        out<<"},"<<endl;
+        out<<"   \"counts\": {";
+        for ( int c=0;c<DetectionStats::NCOUNTERS;c++ )
+            out<< ( c==0?"":", " ) <<"\""<<DetectionStats::getCounterName ( DetectionStats::Counter ( c ) ) <<"\": "<<r.counts[c];
+        out<<"},"<<endl;
+        out<<"   \"accuracy\": {\"recall\": "<<r.recall<<", \"false_positives\": "<<r.falsePositives<<", \"corner_error\": "<<r.cornerError<<"}}"<< ( i+1<results.size() ?",":"" ) <<endl;
+    }
+    out<<"]"<<endl;
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+int main ( int argc,char **argv )
+{
+    try
+    {
+        if ( argc<2 )
+        {
+            cerr<<"Usage: out.(json|csv) [nSyntheticFrames=50] [maxFramesPerVideo=100] [video1.avi video2.avi ...]"<<endl;
+            cerr<<"By default, the videos are testsdata/single/video.avi and testsdata/chessboard/chessboard.avi"<<endl;
+            return 0;
+        }
+        string outFile=argv[1];
+        int nSynthetic=50,maxFrames=100;
+        if ( argc>=3 ) nSynthetic=atoi ( argv[2] );
+        if ( argc>=4 ) maxFrames=atoi ( argv[3] );
+        vector<string> videos;
+        for ( int i=4;i<argc;i++ ) videos.push_back ( argv[i] );
+        if ( videos.empty() )
+        {
+            videos.push_back ( "testsdata/single/video.avi" );
+            videos.push_back ( "testsdata/chessboard/chessboard.avi" );
+        }
+
+        //load all the frames first, so that the decoding of the videos is not measured
+        vector<Dataset> datasets;
+        for ( size_t i=0;i<videos.size();i++ )
+        {
+            Dataset ds;
+            if ( readVideo ( videos[i],maxFrames,ds ) ) datasets.push_back ( ds );
+            else cerr<<"Could not read "<<videos[i]<<". Skipped"<<endl;
+        }
+        if ( nSynthetic>0 )
+        {
+            datasets.push_back ( Dataset() );
+            createSyntheticScenes ( nSynthetic,0,datasets.back() );
+        }
+
+        vector<Result> results;
+        for ( size_t d=0;d<datasets.size();d++ )
+            for ( int thres=0;thres<4;thres++ )
+                for ( int corner=0;corner<4;corner++ )
+                    for ( int pyr=0;pyr<3;pyr++ )
+                        for ( int warpSize=56;warpSize>=28;warpSize/=2 )
+                            for ( int erosion=0;erosion<2;erosion++ )
+                            {
+                                results.push_back ( run ( datasets[d],thres,corner,pyr,warpSize,erosion!=0 ) );
+                                const Result &r=results.back();
+                                cerr<<r.dataset<<" "<<ThresMethodNames[thres]<<" "<<CornerMethodNames[corner]<<" pyrdown="<<pyr<<" warp size="<<warpSize<<" erosion="<<erosion
+                                    <<" fps="<<r.fps<<" detections="<<r.counts[DetectionStats::N_DETECTIONS];
+                                if ( !datasets[d].truth.empty() ) cerr<<" recall="<<r.recall<<" corner error="<<r.cornerError;
+                                cerr<<endl;
+                            }
+
+        ofstream out ( outFile.c_str() );
+        if ( !out ) throw cv::Exception ( 9001,"Could not open "+outFile,"main",__FILE__,__LINE__ );
+        if ( outFile.size() >4 && outFile.substr ( outFile.size()-4 ) ==".csv" ) writeCSV ( out,results );
+        else writeJSON ( out,results );
+    }
+    catch ( std::exception &ex )
+    {
+        cout<<"Exception :"<<ex.what()<<endl;
+    }
+}
@@ -0,0 +1,145 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+/************************************
+ *
+ * Counts the heap allocations done by MarkerDetector::detect in each frame. The operators new and delete are replaced
+ * so that every allocation of the library and of the STL is counted (the memory of cv::Mat is allocated by OpenCV with
+ * its own allocator, so the reallocations of the images of the workspace are given by getNumWorkspaceReallocations).
+ * The frames are these of a video, or synthetic scenes created with SceneGenerator. With -repeat, the first frame is
+ * processed again and again, so that the steady state of the detection can be checked: with -strict, the program fails
+ * if any frame after the first one allocates memory.
+ *
+ ************************************/
+
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include "aruco.h"
+#include "scenegenerator.h"
+using namespace cv;
+using namespace aruco;
+
+//allocations counted by the replaced operators
+static size_t TheNumAllocations=0,TheNumBytes=0;
+
+static void *countedAlloc(size_t size)
+{
+#ifdef _OPENMP
+    #pragma omp critical(aruco_bench_allocations)
+#endif
+    {
+        TheNumAllocations++;
+        TheNumBytes+=size;
+    }
+    void *ptr=malloc(size==0?1:size);
+    if (ptr==NULL) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(size_t size) throw(std::bad_alloc){return countedAlloc(size);}
+void *operator new[](size_t size) throw(std::bad_alloc){return countedAlloc(size);}
+void operator delete(void *ptr) throw(){free(ptr);}
+void operator delete[](void *ptr) throw(){free(ptr);}
+
+int main(int argc,char **argv)
+{
+    try
+    {
+        if (argc<2) {
+            cerr<<"Usage: (video.avi|synthetic) [nFrames=100] [cornerMethod=3 (0 NONE,1 HARRIS,2 SUBPIX,3 LINES)] [-repeat] [-strict]"<<endl;
+            return 0;
+        }
+        string source=argv[1];
+        int nFrames=100,cornerMethod=MarkerDetector::LINES;
+        bool repeat=false,strict=false;
+        for (int i=2,n=0;i<argc;i++) {
+            if (strcmp(argv[i],"-repeat")==0) repeat=true;
+            else if (strcmp(argv[i],"-strict")==0) strict=true;
+            else if (n++==0) nFrames=atoi(argv[i]);
+            else cornerMethod=atoi(argv[i]);
+        }
+
+        //the frames are read before counting
+        vector<Mat> frames;
+        CameraParameters camParams;
+        float markerSize=-1;
+        if (source=="synthetic") {
+            SceneGenerator Generator;
+            camParams=Generator.getCameraParameters();
+            Scene scene;
+            for (int f=0;f<(repeat?1:nFrames);f++) {
+                Generator.generate(f,scene);
+                frames.push_back(scene.image.clone());
+                markerSize=scene.markerSize;
+            }
+        }
+        else {
+            VideoCapture vreader(source);
+            if (!vreader.isOpened()) {
+                cerr<<"Could not open "<<source<<endl;
+                return -1;
+            }
+            Mat frame;
+            while (int(frames.size())<(repeat?1:nFrames) && vreader.grab()) {
+                vreader.retrieve(frame);
+                frames.push_back(frame.clone());
+            }
+            if (frames.empty()) {
+                cerr<<"No frames in "<<source<<endl;
+                return -1;
+            }
+        }
+        if (!repeat) nFrames=frames.size();
+
+        MarkerDetector MDetector;
+        MDetector.setCornerRefinementMethod(MarkerDetector::CornerRefinementMethod(cornerMethod));
+        //the output vector is reused, as in a video loop
+        vector<Marker> Markers;
+        size_t nFramesAllocating=0,prevReallocations=0;
+        for (int f=0;f<nFrames;f++) {
+            const Mat &frame=frames[repeat?0:f];
+            size_t allocations=TheNumAllocations,bytes=TheNumBytes;
+            MDetector.detect(frame,Markers,camParams,markerSize);
+            allocations=TheNumAllocations-allocations;
+            bytes=TheNumBytes-bytes;
+            size_t reallocations=MDetector.getNumWorkspaceReallocations()-prevReallocations;
+            prevReallocations=MDetector.getNumWorkspaceReallocations();
+            if (f>0 && allocations>0) nFramesAllocating++;
+            cout<<"frame "<<f<<" markers="<<Markers.size()<<" allocations="<<allocations<<" bytes="<<bytes
+                <<" workspace reallocations="<<reallocations<<endl;
+        }
+        cout<<"frames after the first one with allocations: "<<nFramesAllocating<<" of "<<(nFrames>0?nFrames-1:0)<<endl;
+        if (strict && nFramesAllocating>0) return 1;
+    } catch (std::exception &ex)
+    {
+        cout<<"Exception :"<<ex.what()<<endl;
+        return -1;
+    }
+    return 0;
+}
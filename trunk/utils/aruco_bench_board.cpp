@@ -0,0 +1,142 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+/************************************
+ *
+ * Benchmark of the searches of markers in large boards: BoardConfiguration::getIndexOfMarkerId, compared with the
+ * linear search employed formerly, and BoardDetector::detect given the markers of a generated board of nMarkers.
+ *
+ ************************************/
+
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include "aruco.h"
+using namespace cv;
+using namespace aruco;
+
+//linear search, as done before the table of indices was added
+static int linearIndexOfMarkerId(const BoardConfiguration &bc,int id)
+{
+    for (size_t i=0;i<bc.size();i++)
+        if (bc[i].id==id) return i;
+    return -1;
+}
+
+int main(int argc,char **argv)
+{
+    try
+    {
+        if (argc<2) {
+            cerr<<"Usage: nMarkers(<1024) [nIterations=100] [seed=0]"<<endl;
+            return 0;
+        }
+        int nMarkers=atoi(argv[1]);
+        int nIterations=100,seed=0;
+        if (argc>=3) nIterations=atoi(argv[2]);
+        if (argc>=4) seed=atoi(argv[3]);
+        //at least one id must be left out of the board for the searches that fail
+        if (nMarkers<1 || nMarkers>=1024) {
+            cerr<<"nMarkers must be in [1,1023]"<<endl;
+            return -1;
+        }
+
+        //board of markers of 100 pixels in a grid, with random ids, as FiducidalMarkers::createBoardImage does
+        RNG rng(seed);
+        vector<int> ids(1024);
+        for (int i=0;i<1024;i++) ids[i]=i;
+        for (int i=1023;i>0;i--) std::swap(ids[i],ids[rng.uniform(0,i+1)]);
+        int gridW=ceil(sqrt(double(nMarkers)));
+        int gridH=(nMarkers+gridW-1)/gridW;
+        const int markerPix=100,distPix=20;
+        BoardConfiguration bc;
+        bc.mInfoType=BoardConfiguration::PIX;
+        bc.resize(nMarkers);
+        for (int i=0;i<nMarkers;i++) {
+            float x=(i%gridW)*(markerPix+distPix)-gridW*(markerPix+distPix)/2.;
+            float y=(i/gridW)*(markerPix+distPix)-gridH*(markerPix+distPix)/2.;
+            bc[i].id=ids[i];
+            bc[i].push_back(Point3f(x,y,0));
+            bc[i].push_back(Point3f(x+markerPix,y,0));
+            bc[i].push_back(Point3f(x+markerPix,y+markerPix,0));
+            bc[i].push_back(Point3f(x,y+markerPix,0));
+        }
+        bc.updateIdIndex();
+
+        //markers seen by a camera in front of the board, so that it occupies 1500 pixels
+        float markerSize=0.05,metersPerPix=markerSize/markerPix,f=800;
+        float z=f*gridW*(markerPix+distPix)*metersPerPix/1500.;
+        Mat camMatrix=Mat::eye(3,3,CV_32F);
+        camMatrix.at<float>(0,0)=camMatrix.at<float>(1,1)=f;
+        camMatrix.at<float>(0,2)=960;
+        camMatrix.at<float>(1,2)=540;
+        CameraParameters CP(camMatrix,Mat::zeros(4,1,CV_32F),Size(1920,1080));
+        vector<Marker> markers(nMarkers);
+        for (int i=0;i<nMarkers;i++) {
+            markers[i].id=bc[i].id;
+            for (int c=0;c<4;c++)
+                markers[i].push_back(Point2f(960+f*bc[i][c].x*metersPerPix/z,540+f*bc[i][c].y*metersPerPix/z));
+        }
+        std::swap(markers[0],markers[nMarkers-1]);
+
+        //searches of the ids of the board and of as many ids that are not in it (ids[nMarkers..1023], repeated if required)
+        vector<int> queries(2*nMarkers);
+        for (int i=0;i<2*nMarkers;i++) queries[i]=i<nMarkers?bc[i].id:ids[nMarkers+(i-nMarkers)%(1024-nMarkers)];
+        long sum=0;
+        double tick=(double)getTickCount();
+        for (int it=0;it<nIterations;it++)
+            for (size_t i=0;i<queries.size();i++) sum+=linearIndexOfMarkerId(bc,queries[i]);
+        double linearSecs=((double)getTickCount()-tick)/getTickFrequency();
+        tick=(double)getTickCount();
+        for (int it=0;it<nIterations;it++)
+            for (size_t i=0;i<queries.size();i++) sum-=bc.getIndexOfMarkerId(queries[i]);
+        double indexSecs=((double)getTickCount()-tick)/getTickFrequency();
+        if (sum!=0) {
+            cerr<<"The searches do not match"<<endl;
+            return -1;
+        }
+        double nQueries=double(nIterations)*queries.size();
+        cout<<"markers="<<nMarkers<<" linear search="<<1e9*linearSecs/nQueries<<" ns indexed search="<<1e9*indexSecs/nQueries<<" ns"<<endl;
+
+        //detection of the board given the markers, without and with its pose
+        BoardDetector BD;
+        Board board;
+        for (int withPose=0;withPose<2;withPose++) {
+            float prob=0;
+            tick=(double)getTickCount();
+            for (int it=0;it<nIterations;it++) {
+                if (withPose) prob=BD.detect(markers,bc,board,CP,markerSize);
+                else prob=BD.detect(markers,bc,board);
+            }
+            double secs=((double)getTickCount()-tick)/getTickFrequency();
+            cout<<"BoardDetector::detect"<<(withPose?" with pose":"")<<" prob="<<prob<<" time per call="<<1000*secs/nIterations<<" ms"<<endl;
+        }
+    } catch (std::exception &ex)
+    {
+        cout<<"Exception :"<<ex.what()<<endl;
+    }
+}
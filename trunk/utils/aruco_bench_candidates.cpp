@@ -0,0 +1,94 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+/************************************
+ *
+ * Benchmark of the rectangle detection (MarkerDetector::detectRectangles) with a synthetic
+ * thresholded image flooded with squares, with each of the contour extraction methods.
+ * Each square has a thin hole, so that its outer and inner borders give two candidates too
+ * near to each other that must be removed.
+ *
+ ************************************/
+
+#include <iostream>
+#include <cstdlib>
+#include "aruco.h"
+using namespace cv;
+using namespace aruco;
+
+int main(int argc,char **argv)
+{
+    try
+    {
+        if (argc<2) {
+            cerr<<"Usage: nSquares [imageSize=2000] [nIterations=20] [seed=0]"<<endl;
+            return 0;
+        }
+        int nSquares=atoi(argv[1]);
+        int imageSize=2000,nIterations=20,seed=0;
+        if (argc>=3) imageSize=atoi(argv[2]);
+        if (argc>=4) nIterations=atoi(argv[3]);
+        if (argc>=5) seed=atoi(argv[4]);
+
+        //create the image with squares of random sizes, positions and orientations.
+        Mat thres(imageSize,imageSize,CV_8UC1,Scalar(0));
+        RNG rng(seed);
+        for (int i=0;i<nSquares;i++) {
+            float side=rng.uniform(20.f,60.f);
+            Point2f center(rng.uniform(side,imageSize-side),rng.uniform(side,imageSize-side));
+            float angle=rng.uniform(0.f,360.f);
+            Point2f pts[4];
+            Point poly[4];
+            RotatedRect(center,Size2f(side,side),angle).points(pts);
+            for (int c=0;c<4;c++) poly[c]=pts[c];
+            fillConvexPoly(thres,poly,4,Scalar(255));
+            RotatedRect(center,Size2f(side-4,side-4),angle).points(pts);
+            for (int c=0;c<4;c++) poly[c]=pts[c];
+            fillConvexPoly(thres,poly,4,Scalar(0));
+        }
+
+        //the minimum size is reduced so that the small squares are considered
+        MarkerDetector MDetector;
+        MDetector.setMinMaxSize(0.01,0.5);
+        //run with each contour extraction method
+        const char *methodNames[2]={"OPENCV_CONTOURS","BORDER_FOLLOWING"};
+        MarkerDetector::ContourExtractionMethod methods[2]={MarkerDetector::OPENCV_CONTOURS,MarkerDetector::BORDER_FOLLOWING};
+        for (int m=0;m<2;m++) {
+            MDetector.setContourExtractionMethod(methods[m]);
+            vector<vector<Point2f> > candidates;
+            double tick=(double)getTickCount();
+            for (int i=0;i<nIterations;i++)
+                MDetector.detectRectangles(thres,candidates);
+            double secs=((double)getTickCount()-tick)/getTickFrequency();
+
+            cout<<methodNames[m]<<" squares="<<nSquares<<" candidates="<<candidates.size()<<" time per call="<<1000*secs/nIterations<<" ms"<<endl;
+        }
+    } catch (std::exception &ex)
+    {
+        cout<<"Exception :"<<ex.what()<<endl;
+    }
+}
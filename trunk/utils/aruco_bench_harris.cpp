@@ -0,0 +1,103 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+/************************************
+ *
+ * Benchmark of the HARRIS corner refinement (MarkerDetector::findBestCornerInRegion_harris) against its previous
+ * implementation based on cv::goodFeaturesToTrack. A synthetic image is flooded with squares, and their corners
+ * are displaced randomly and refined by both. The time per call and the mean distance to the true corners are shown.
+ *
+ ************************************/
+
+#include <iostream>
+#include <cstdlib>
+#include "aruco.h"
+using namespace cv;
+using namespace aruco;
+
+//mean distance between the corners refined and the true ones
+static double meanError(const vector<Point2f> &corners,const vector<Point2f> &trueCorners)
+{
+    double sum=0;
+    for (size_t i=0;i<corners.size();i++) sum+=norm(corners[i]-trueCorners[i]);
+    return corners.size()==0?0:sum/corners.size();
+}
+
+int main(int argc,char **argv)
+{
+    try
+    {
+        if (argc<2) {
+            cerr<<"Usage: nSquares [imageSize=2000] [nIterations=20] [seed=0]"<<endl;
+            return 0;
+        }
+        int nSquares=atoi(argv[1]);
+        int imageSize=2000,nIterations=20,seed=0;
+        if (argc>=3) imageSize=atoi(argv[2]);
+        if (argc>=4) nIterations=atoi(argv[3]);
+        if (argc>=5) seed=atoi(argv[4]);
+
+        //create the image with dark squares of random sizes, positions and orientations on a bright background
+        Mat grey(imageSize,imageSize,CV_8UC1,Scalar(200));
+        RNG rng(seed);
+        vector<Point2f> trueCorners,initialCorners;
+        for (int i=0;i<nSquares;i++) {
+            float side=rng.uniform(20.f,60.f);
+            Point2f center(rng.uniform(side,imageSize-side),rng.uniform(side,imageSize-side));
+            float angle=rng.uniform(0.f,360.f);
+            Point2f pts[4];
+            Point poly[4];
+            RotatedRect(center,Size2f(side,side),angle).points(pts);
+            for (int c=0;c<4;c++) {
+                poly[c]=pts[c];
+                trueCorners.push_back(pts[c]);
+                initialCorners.push_back(pts[c]+Point2f(rng.uniform(-2.5f,2.5f),rng.uniform(-2.5f,2.5f)));
+            }
+            fillConvexPoly(grey,poly,4,Scalar(rng.uniform(0,80)));
+        }
+        GaussianBlur(grey,grey,Size(3,3),0.8);
+
+        MarkerDetector MDetector;
+        const char *methodNames[2]={"goodFeaturesToTrack","batched"};
+        for (int m=0;m<2;m++) {
+            vector<Point2f> corners;
+            double tick=(double)getTickCount();
+            for (int i=0;i<nIterations;i++) {
+                corners=initialCorners;
+                if (m==0) MDetector.findBestCornerInRegion_harris_goodFeatures(grey,corners,7);
+                else MDetector.findBestCornerInRegion_harris(grey,corners,7);
+            }
+            double secs=((double)getTickCount()-tick)/getTickFrequency();
+
+            cout<<methodNames[m]<<" corners="<<corners.size()<<" time per call="<<1000*secs/nIterations<<" ms"
+                <<" error="<<meanError(corners,trueCorners)<<" px (initial "<<meanError(initialCorners,trueCorners)<<" px)"<<endl;
+        }
+    } catch (std::exception &ex)
+    {
+        cout<<"Exception :"<<ex.what()<<endl;
+    }
+}
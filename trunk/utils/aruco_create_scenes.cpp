@@ -0,0 +1,89 @@
+/*****************************
+Copyright 2011 Rafael Muñoz Salinas. All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification, are
+permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice, this list of
+      conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright notice, this list
+      of conditions and the following disclaimer in the documentation and/or other materials
+      provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY Rafael Muñoz Salinas ''AS IS'' AND ANY EXPRESS OR IMPLIED
+WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL Rafael Muñoz Salinas OR
+CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those of the
+authors and should not be interpreted as representing official policies, either expressed
+or implied, of Rafael Muñoz Salinas.
+********************************/
+/************************************
+ *
+ * Creates a set of synthetic scenes with markers (see SceneGenerator). For each scene, the image scene_NNNNN.png and its
+ * ground truth scene_NNNNN.yml are written in the output directory, along with the camera parameters in camera.yml.
+ * The scenes only depend on the seed, so that the same set is obtained in every run. Optionally, a board created with
+ * aruco_create_board can be placed in the scenes.
+ *
+ ************************************/
+
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include "aruco.h"
+#include "scenegenerator.h"
+using namespace cv;
+using namespace aruco;
+
+int main(int argc,char **argv)
+{
+    try
+    {
+        if (argc<3) {
+            cerr<<"Usage: outDir nScenes [seed=0] [board.png board.yml]"<<endl;
+            return 0;
+        }
+        string outDir=argv[1];
+        int nScenes=atoi(argv[2]);
+        int seed=0;
+        if (argc>=4) seed=atoi(argv[3]);
+
+        SceneGenerator Generator(SceneGenerator::Params(),seed);
+        if (argc>=6) {
+            BoardConfiguration BConf;
+            BConf.readFromFile(argv[5]);
+            Mat boardImage=imread(argv[4],0);
+            if (boardImage.empty()) {
+                cerr<<"Could not read "<<argv[4]<<endl;
+                return -1;
+            }
+            Generator.addBoard(boardImage,BConf);
+        }
+        CameraParameters CamParam=Generator.getCameraParameters();
+        CamParam.saveToFile(outDir+"/camera.yml");
+
+        //the scenes are independent, so they can be created in parallel
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic)
+#endif
+        for (int i=0;i<nScenes;i++) {
+            Scene S;
+            Generator.generate(i,S);
+            char name[64];
+            sprintf(name,"/scene_%05d",i);
+            imwrite(outDir+name+".png",S.image);
+            S.saveToFile(outDir+name+".yml");
+        }
+        cout<<nScenes<<" scenes written in "<<outDir<<endl;
+    } catch (std::exception &ex)
+    {
+        cout<<"Exception :"<<ex.what()<<endl;
+    }
+}
@@ -271,7 +271,7 @@ void vIdle()
         //by deafult, opencv works in BGR, so we must convert to RGB because OpenGL in windows preffer
         cv::cvtColor(TheInputImage,TheInputImage,CV_BGR2RGB);
         //remove distorion in image
-        cv::undistort(TheInputImage,TheUndInputImage, TheCameraParams.CameraMatrix,TheCameraParams.Distorsion);
+        TheCameraParams.undistort(TheInputImage,TheUndInputImage);
         //detect markers
         MDetector.detect(TheUndInputImage,TheMarkers,TheCameraParams.CameraMatrix,Mat(),TheMarkerSize);
         //Detection of the board
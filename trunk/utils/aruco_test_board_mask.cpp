@@ -126,7 +126,7 @@ int main(int argc,char **argv)
 			TheVideoCapturer.retrieve( TheInputImage);  
 			//undistord image if possible
 			if (camParamsOrg.isValid()){
-			  cv::undistort(TheInputImage,TheInputImageCopy, camParamsOrg.CameraMatrix,camParamsOrg.Distorsion);
+			  camParamsOrg.undistort(TheInputImage,TheInputImageCopy);
 			  TheInputImageCopy.copyTo(TheInputImage);
 			  camParams=camParamsOrg;
 			  camParams.Distorsion=cv::Mat::zeros(4,1,CV_32FC1);
@@ -246,7 +246,7 @@ void vIdle()
         //transform color that by default is BGR to RGB because windows systems do not allow reading BGR images with opengl properly
         cv::cvtColor(TheInputImage,TheInputImage,CV_BGR2RGB);
         //remove distorion in image
-        cv::undistort(TheInputImage,TheUndInputImage, TheCameraParams.CameraMatrix, TheCameraParams.Distorsion);
+        TheCameraParams.undistort(TheInputImage,TheUndInputImage);
         //detect markers
         PPDetector.detect(TheUndInputImage,TheMarkers, TheCameraParams.CameraMatrix,Mat(),TheMarkerSize);
         //resize the image to the size of the GL window